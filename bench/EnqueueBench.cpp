@@ -0,0 +1,93 @@
+// Measures the per-point cost of the Sender enqueue APIs: one call per point vs. one batch
+// per sampler tick. The sinks are "null" and the sender thread is not started, so only the
+// producer side is measured.
+//
+// Usage: sensor-bench [points] [sensors]
+
+#include "Sender.h"
+#include "HistoryStore.h"
+#include <Poco/Util/LayeredConfiguration.h>
+#include <Poco/Util/MapConfiguration.h>
+#include <Poco/AutoPtr.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+using namespace std::chrono;
+
+static Poco::AutoPtr<Configuration> makeConfig() {
+    Poco::AutoPtr<Configuration> cfg(new Configuration());
+    cfg->add(new Poco::Util::MapConfiguration());
+    cfg->setString("timeseries.sink", "null");
+    cfg->setString("asset.sink", "null");
+    return cfg;
+}
+
+// Points enqueued on each Sender. The queues are never drained, so the Sender is recreated
+// every round: the freed memory is reused and page faults stay out of the measurement.
+#define ROUND_POINTS 100000
+
+// Nanoseconds per point of 'enqueue(sender, ticks)', run in rounds on fresh Senders
+template <typename F>
+static double measure(int64_t ticks, int sensors, F enqueue) {
+    auto cfg = makeConfig();
+    HistoryStore history(*cfg);
+    int64_t roundTicks = max((int64_t) 1, (int64_t) (ROUND_POINTS / sensors));
+
+    nanoseconds elapsed(0);
+    for (int64_t done = 0; done < ticks; done += roundTicks) {
+        Sender sender(*cfg, history);
+        auto start = steady_clock::now();
+        enqueue(sender, min(roundTicks, ticks - done));
+        elapsed += duration_cast<nanoseconds>(steady_clock::now() - start);
+    }
+    return (double) elapsed.count() / (ticks * sensors);
+}
+
+int main(int argc, char **argv) {
+    int64_t points = argc > 1 ? atoll(argv[1]) : 2000000;
+    int sensors = argc > 2 ? atoi(argv[2]) : 1000;
+    if (sensors <= 0 || points < sensors) {
+        fprintf(stderr, "Usage: %s [points] [sensors], with points >= sensors > 0\n", argv[0]);
+        return 1;
+    }
+
+    vector<string> tags;
+    for (int i = 0; i < sensors; i++) {
+        tags.push_back("3f2a9c4e-5b1d-4e8f-9a7c-2d6b8e1f0a3c-" + to_string(i));
+    }
+    int64_t ticks = points / sensors;
+    points = ticks * sensors;
+
+    double single = measure(ticks, sensors, [&](Sender &sender, int64_t ticks) {
+        for (int64_t tick = 0; tick < ticks; tick++) {
+            for (auto &tag : tags) {
+                sender.queueTimeseriesMessage(tag, tick, 0.5);
+            }
+        }
+    });
+
+    double batched = measure(ticks, sensors, [&](Sender &sender, int64_t ticks) {
+        vector<TimeSeriesMessage> batch;
+        batch.reserve(tags.size());
+        for (int64_t tick = 0; tick < ticks; tick++) {
+            for (auto &tag : tags) {
+                batch.emplace_back();
+                auto &msg = batch.back();
+                msg.tagname = tag;
+                msg.timestamp = tick;
+                msg.value = 0.5;
+            }
+            sender.queueTimeseriesMessages(batch);
+        }
+    });
+
+    printf("%lld points, %d sensors per tick\n", (long long) points, sensors);
+    printf("queueTimeseriesMessage   %8.1f ns/point\n", single);
+    printf("queueTimeseriesMessages  %8.1f ns/point (%.1fx)\n", batched, single / batched);
+    return 0;
+}
@@ -0,0 +1,140 @@
+#include "QueryApplication.h"
+#include "Capture.h"
+#include "errors.h"
+#include <Poco/Util/Option.h>
+#include <Poco/Net/HTTPSStreamFactory.h>
+#include <Poco/Net/SSLManager.h>
+#include <Poco/File.h>
+#include <Poco/Path.h>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <queue>
+#include <chrono>
+
+using namespace std;
+using namespace Poco::Util;
+
+void QueryApplication::defineOptions(OptionSet &options) {
+    Application::defineOptions(options);
+
+    options.addOption(Option("format", "f", "Output format: csv (default) or binary.")
+                              .argument("format").binding("query.format"));
+    options.addOption(Option("output", "o", "Output file. CSV defaults to the standard output.")
+                              .argument("file").binding("query.output"));
+    options.addOption(Option("start", "s", "Query start, eg. '2y-ago' (default) or epoch millis.")
+                              .argument("start").binding("query.start"));
+    options.addOption(Option("limit", "l", "Maximum datapoints per tag (default 10000).")
+                              .argument("n").binding("query.limit"));
+    options.addOption(Option("threads", "t", "Concurrent tag fetches (default 8).")
+                              .argument("n").binding("query.threads"));
+    options.addOption(Option("ca", "c", "CA bundle (default conf/ca-certificates.crt).")
+                              .argument("file").binding("query.ca"));
+}
+
+// Quotes a CSV field holding separators, quotes or line breaks (RFC 4180)
+static string csvField(const string &field) {
+    if (field.find_first_of(",\"\r\n") == string::npos)
+        return field;
+    string quoted = "\"";
+    for (char c : field) {
+        if (c == '"') quoted.push_back('"');
+        quoted.push_back(c);
+    }
+    quoted.push_back('"');
+    return quoted;
+}
+
+void QueryApplication::writeCsv(const std::vector<TagColumns> &results, std::ostream &out) {
+    out << "tag,timestamp,value,quality\n" << setprecision(17);
+    for (auto &tag : results) {
+        string name = csvField(tag.name);
+        for (size_t i = 0, n = tag.timestamps.size(); i < n; i++) {
+            out << name << ',' << tag.timestamps[i] << ',' << tag.values[i] << ','
+                << (int) tag.qualities[i] << '\n';
+        }
+    }
+}
+
+void QueryApplication::writeBinary(const std::vector<TagColumns> &results,
+                                   const std::string &path) {
+    // Merge the tags by timestamp, so the capture replays like the original stream
+    typedef pair<int64_t, pair<size_t, size_t>> Cursor;
+    priority_queue<Cursor, vector<Cursor>, greater<Cursor>> cursors;
+    for (size_t t = 0; t < results.size(); t++) {
+        if (!results[t].timestamps.empty())
+            cursors.push({results[t].timestamps[0], {t, 0}});
+    }
+
+    capture::Writer writer(path);
+    while (!cursors.empty()) {
+        auto cursor = cursors.top();
+        cursors.pop();
+        auto &tag = results[cursor.second.first];
+        size_t i = cursor.second.second;
+        writer.writeTimeseries(tag.name, tag.timestamps[i], tag.values[i]);
+        if (++i < tag.timestamps.size())
+            cursors.push({tag.timestamps[i], {cursor.second.first, i}});
+    }
+    writer.flush();
+}
+
+int QueryApplication::main(const std::vector<std::string> &args) {
+    string ini = args.size() > 0 ? args[0] : "conf/server.ini";
+    if (!Poco::File(ini).exists()) {
+        cerr << "ERROR: Cannot read " << ini << ". Pass the server INI file as the sole argument "
+                "of the program." << endl;
+        return ERR_INVALID_CONF_DIR;
+    }
+    loadConfiguration(ini);
+    Poco::Logger::root().setLevel(config().getString("logging.loglevel", "information"));
+    auto &logger = Poco::Logger::get("QueryApplication");
+
+    string format = config().getString("query.format", "csv");
+    string output = config().getString("query.output", "");
+    if (format != "csv" && format != "binary") {
+        cerr << "ERROR: Invalid format: " << format << endl;
+        return EXIT_USAGE;
+    }
+    if (format == "binary" && output.empty()) {
+        cerr << "ERROR: The binary format requires an --output file." << endl;
+        return EXIT_USAGE;
+    }
+
+    // Setup and initialize SSL
+    auto certs = Poco::Path(config().getString("query.ca", "conf/ca-certificates.crt"))
+            .absolute().toString();
+    config().setString("openSSL.client.caConfig", certs);
+    Poco::Net::initializeSSL();
+
+    try {
+        auto start = chrono::steady_clock::now();
+        QueryClient client(config());
+        client.login();
+        auto tags = client.fetchTags();
+        logger.information("Fetching %d tags.", (int) tags.size());
+        auto results = client.fetchAll(tags, config().getInt("query.threads", 8));
+
+        size_t points = 0;
+        for (auto &tag : results) points += tag.timestamps.size();
+        auto elapsed = chrono::duration_cast<chrono::milliseconds>(
+                chrono::steady_clock::now() - start).count();
+        logger.information("Fetched %d points in %d ms.", (int) points, (int) elapsed);
+
+        if (format == "binary") {
+            writeBinary(results, output);
+        } else if (output.empty()) {
+            writeCsv(results, cout);
+        } else {
+            ofstream out(output);
+            writeCsv(results, out);
+        }
+    } catch (int err) {
+        logger.error("Query failed with error %d.", err);
+        return err;
+    }
+
+    return EXIT_OK;
+}
+
+POCO_APP_MAIN(QueryApplication);
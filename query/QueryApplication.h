@@ -0,0 +1,32 @@
+#ifndef PREDIX_QUERYAPPLICATION_H
+#define PREDIX_QUERYAPPLICATION_H
+
+#include <Poco/Util/Application.h>
+#include <Poco/Util/OptionSet.h>
+#include "QueryClient.h"
+
+/**
+ * "sensor-query": exports the ingested timeseries of every tag as CSV or as a binary
+ * capture (see Capture.h, which the sensor can replay).
+ *
+ * Usage: sensor-query [--format=csv|binary] [--output=FILE] [--start=2y-ago]
+ *                     [--limit=N] [--threads=N] [server.ini]
+ *
+ * Uses the "server" UAA client, so it takes the verification server configuration
+ * (conf/server.ini by default).
+ */
+class QueryApplication : public Poco::Util::Application {
+
+    void writeCsv(const std::vector<TagColumns> &results, std::ostream &out);
+
+    void writeBinary(const std::vector<TagColumns> &results, const std::string &path);
+
+protected:
+
+    void defineOptions(Poco::Util::OptionSet &options) override;
+
+    int main(const std::vector<std::string> &args) override;
+};
+
+
+#endif //PREDIX_QUERYAPPLICATION_H
@@ -0,0 +1,224 @@
+#include "QueryClient.h"
+#include "JsonSax.h"
+#include "errors.h"
+#include <nlohmann/json.hpp>
+#include <atomic>
+#include <thread>
+#include <cstdlib>
+#include <limits>
+
+#define REQUEST_TIMEOUT_MS 60000
+
+using namespace std;
+using namespace nlohmann;
+
+namespace {
+
+/**
+ * Collects the "values" arrays of a query response ([[timestamp, value, quality], ...]).
+ */
+class ValuesHandler : public JsonSaxHandler {
+
+    TagColumns &out;
+
+    int depth = 0;
+
+    // Depth of the "values" array being read, 0 if outside
+    int valuesDepth = 0;
+
+    bool valuesNext = false;
+
+    // Index of the next field in the current datapoint
+    int field = 0;
+
+    bool inPoint() const {
+        return valuesDepth && depth == valuesDepth + 1;
+    }
+
+    void pointValue(double value, int64_t integer) {
+        if (!inPoint())
+            return;
+        if (field == 0) {
+            out.timestamps.push_back(integer);
+        } else if (field == 1) {
+            out.values.push_back(value);
+        } else if (field == 2) {
+            out.qualities.push_back((int8_t) integer);
+        }
+        field++;
+    }
+
+public:
+
+    ValuesHandler(TagColumns &out) : out(out) {}
+
+    void startObject() override {
+        depth++;
+        valuesNext = false;
+    }
+
+    void endObject() override {
+        depth--;
+    }
+
+    void startArray() override {
+        depth++;
+        if (valuesNext) {
+            valuesDepth = depth;
+            valuesNext = false;
+        } else if (inPoint()) {
+            field = 0;
+        }
+    }
+
+    void endArray() override {
+        if (inPoint()) {
+            // Keep the columns aligned even for short datapoints
+            if (out.values.size() < out.timestamps.size())
+                out.values.push_back(numeric_limits<double>::quiet_NaN());
+            if (out.qualities.size() < out.timestamps.size())
+                out.qualities.push_back(0);
+        } else if (depth == valuesDepth) {
+            valuesDepth = 0;
+        }
+        depth--;
+    }
+
+    void key(const std::string &name) override {
+        valuesNext = name == "values";
+    }
+
+    // Only an array right after the "values" key holds the datapoints
+
+    void stringValue(const std::string &) override {
+        valuesNext = false;
+    }
+
+    void numberValue(double value, const std::string &raw) override {
+        valuesNext = false;
+        pointValue(value, strtoll(raw.c_str(), nullptr, 10));
+    }
+
+    void boolValue(bool) override {
+        valuesNext = false;
+    }
+
+    void nullValue() override {
+        valuesNext = false;
+        pointValue(numeric_limits<double>::quiet_NaN(), 0);
+    }
+};
+
+}
+
+QueryClient::QueryClient(Poco::Util::AbstractConfiguration &cfg) :
+        cfg(cfg),
+        queryUri(cfg.getString("timeseries.query_uri")),
+        zoneId(cfg.getString("timeseries.zone_id")),
+        uaa(cfg.getString("uaa.uri"), cfg.getString("server.client_id"),
+            cfg.getString("server.client_secret"), REQUEST_TIMEOUT_MS),
+        logger(Poco::Logger::get("QueryClient")) {
+    uaa.setSessionPool(&pool);
+}
+
+void QueryClient::login() {
+    auto fresh = uaa.fetchToken().accessToken;
+    unique_lock<mutex> lock(tokenMutex);
+    token = fresh;
+}
+
+std::string QueryClient::currentToken() {
+    unique_lock<mutex> lock(tokenMutex);
+    return token;
+}
+
+HTTPClient::Response QueryClient::request(const std::string &uri, const std::string &body,
+                                          const HTTPClient::BodyHandler &handler) {
+    HTTPClient::Response r;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        auto client = HTTPClient(uri);
+        client.setSessionPool(&pool);
+        client.setTimeout(REQUEST_TIMEOUT_MS);
+        client.setHeader("Authorization", "Bearer " + currentToken());
+        client.setHeader("Predix-Zone-Id", zoneId);
+        if (!body.empty()) {
+            client.setBody(body);
+            client.setContentType(HTTPClient::CT_JSON);
+            r = client.post(handler);
+        } else {
+            r = client.get(handler);
+        }
+
+        if (r.error_code != HTTPClient::OK || r.status_code != 401 || attempt > 0)
+            break;
+
+        // The token expired while we were working
+        logger.information("Access token rejected, fetching a new one.");
+        login();
+    }
+    HTTPClient::validateResponse(r);
+    return r;
+}
+
+std::vector<std::string> QueryClient::fetchTags() {
+    // Same convention as the verification server
+    string uri = queryUri;
+    auto pos = uri.find("/datapoints");
+    if (pos != string::npos)
+        uri.replace(pos, string("/datapoints").size(), "/tags");
+
+    auto r = request(uri, "", nullptr);
+    auto data = json::parse(r.text);
+    vector<string> tags;
+    for (auto &tag : data["results"]) {
+        tags.push_back(tag.get<string>());
+    }
+    return tags;
+}
+
+TagColumns QueryClient::fetchTag(const std::string &tag) {
+    json tagQuery = {{"name",  tag},
+                     {"order", "asc"}};
+    int limit = cfg.getInt("query.limit", 10000);
+    if (limit > 0)
+        tagQuery["limit"] = limit;
+    json body = {{"tags",  json::array({tagQuery})},
+                 {"start", cfg.getString("query.start", "2y-ago")}};
+
+    TagColumns columns;
+    columns.name = tag;
+    request(queryUri, body.dump(), [&columns](std::istream &in) {
+        ValuesHandler handler(columns);
+        JsonSaxParser parser(handler);
+        parser.parse(in);
+    });
+    return columns;
+}
+
+std::vector<TagColumns> QueryClient::fetchAll(const std::vector<std::string> &tags, int threads) {
+    vector<TagColumns> results(tags.size());
+    atomic<size_t> next(0);
+    atomic<int> error(ERR_OK);
+
+    auto worker = [&]() {
+        for (size_t i; error == ERR_OK && (i = next++) < tags.size();) {
+            try {
+                results[i] = fetchTag(tags[i]);
+                logger.debug("Fetched %d points of %s", (int) results[i].timestamps.size(), tags[i]);
+            } catch (int err) {
+                logger.error("Error fetching tag %s", tags[i]);
+                error = err;
+            }
+        }
+    };
+
+    vector<thread> workers;
+    for (int i = 0; i < max(1, threads); i++) {
+        workers.emplace_back(worker);
+    }
+    for (auto &t : workers) t.join();
+
+    if (error != ERR_OK)
+        throw (int) error;
+    return results;
+}
@@ -0,0 +1,79 @@
+#ifndef PREDIX_QUERYCLIENT_H
+#define PREDIX_QUERYCLIENT_H
+
+#include <Poco/Util/AbstractConfiguration.h>
+#include <Poco/Logger.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include "HTTPClient.h"
+#include "HTTPSessionPool.h"
+#include "UAAClient.h"
+
+// Datapoints of a single tag, in columnar form
+struct TagColumns {
+    std::string name;
+    std::vector<int64_t> timestamps;
+    std::vector<double> values;
+    std::vector<int8_t> qualities;
+};
+
+/**
+ * Client of the Predix Timeseries query API.
+ *
+ * Tags are fetched concurrently by a pool of worker threads sharing keep-alive
+ * connections, and responses are parsed while they stream in, straight into columnar
+ * buffers.
+ */
+class QueryClient {
+
+    Poco::Util::AbstractConfiguration &cfg;
+
+    std::string queryUri;
+
+    std::string zoneId;
+
+    HTTPSessionPool pool;
+
+    UAAClient uaa;
+
+    // The current access_token, shared by all workers
+    std::string token;
+
+    std::mutex tokenMutex;
+
+    Poco::Logger &logger;
+
+    std::string currentToken();
+
+    /**
+     * Performs the request with the current token, refreshing it once on a 401 response.
+     */
+    HTTPClient::Response request(const std::string &uri, const std::string &body,
+                                 const HTTPClient::BodyHandler &handler);
+
+public:
+
+    QueryClient(Poco::Util::AbstractConfiguration &cfg);
+
+    /**
+     * Fetches the access_token. Throws the error codes in errors.h on failure.
+     */
+    void login();
+
+    std::vector<std::string> fetchTags();
+
+    /**
+     * Fetches the datapoints of a single tag ("query.start", "query.limit").
+     */
+    TagColumns fetchTag(const std::string &tag);
+
+    /**
+     * Fetches all tags using 'threads' concurrent workers. Results are in 'tags' order.
+     */
+    std::vector<TagColumns> fetchAll(const std::vector<std::string> &tags, int threads);
+};
+
+
+#endif //PREDIX_QUERYCLIENT_H
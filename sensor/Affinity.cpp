@@ -0,0 +1,186 @@
+#include "Affinity.h"
+#include "errors.h"
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <cstdlib>
+#include <cerrno>
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// From <numaif.h>, which is not installed by default
+#define MPOL_PREFERRED 1
+#endif
+
+#define NODE_CPULIST "/sys/devices/system/node/node%d/cpulist"
+
+using namespace std;
+
+Affinity::Affinity(Configuration &cfg) :
+        logger(Poco::Logger::get("Affinity")) {
+    detectTopology();
+    samplerCpus = parseCpus(cfg, "affinity.sampler");
+    senderCpus = parseCpus(cfg, "affinity.sender");
+    workerCpus = parseCpus(cfg, "affinity.workers");
+    numaQueues = cfg.getBool("affinity.numa_queues", true);
+}
+
+void Affinity::detectTopology() {
+    cpuCount = max(1, (int) thread::hardware_concurrency());
+
+    // Node ids are contiguous on the platforms we run
+    for (int node = 0;; node++) {
+        char path[64];
+        snprintf(path, sizeof(path), NODE_CPULIST, node);
+        ifstream in(path);
+        string list;
+        if (!in || !getline(in, list))
+            break;
+        nodes.push_back(parseCpuList(list));
+    }
+
+#ifdef __linux__
+    // Must run before any thread is pinned: the constructing thread still has the process mask
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) startupCpus.push_back(cpu);
+        }
+    }
+#endif
+    if (startupCpus.empty()) {
+        for (int cpu = 0; cpu < cpuCount; cpu++) startupCpus.push_back(cpu);
+    }
+
+    // No NUMA information: a single node with every CPU
+    if (nodes.empty()) {
+        nodes.emplace_back();
+        for (int cpu = 0; cpu < cpuCount; cpu++) nodes[0].push_back(cpu);
+    }
+}
+
+std::vector<int> Affinity::parseCpuList(const std::string &list) {
+    vector<int> cpus;
+    istringstream in(list);
+    string range;
+    while (getline(in, range, ',')) {
+        if (range.find_first_not_of(" \t\r\n") == string::npos)
+            continue;
+        char *end;
+        long first = strtol(range.c_str(), &end, 10);
+        long last = first;
+        if (*end == '-')
+            last = strtol(end + 1, &end, 10);
+        while (*end == ' ' || *end == '\t' || *end == '\r' || *end == '\n') end++;
+        if (*end != '\0' || first < 0 || last < first) {
+            Poco::Logger::get("Affinity").error("Invalid CPU list: %s", list);
+            throw ERR_GENERIC_EXCEPTION;
+        }
+        for (long cpu = first; cpu <= last; cpu++) cpus.push_back((int) cpu);
+    }
+    return cpus;
+}
+
+std::vector<int> Affinity::parseCpus(Configuration &cfg, const std::string &key) {
+    auto cpus = parseCpuList(cfg.getString(key, ""));
+    for (int cpu : cpus) {
+        if (cpu >= cpuCount) {
+            logger.error("%s: CPU %d does not exist (%d CPUs available)", key, cpu, cpuCount);
+            throw ERR_GENERIC_EXCEPTION;
+        }
+    }
+    return cpus;
+}
+
+int Affinity::nodeOf(int cpu) const {
+    for (size_t node = 0; node < nodes.size(); node++) {
+        if (find(nodes[node].begin(), nodes[node].end(), cpu) != nodes[node].end())
+            return (int) node;
+    }
+    return 0;
+}
+
+int Affinity::nodeOf(const std::vector<int> &cpus) const {
+    if (cpus.empty())
+        return -1;
+    int node = nodeOf(cpus[0]);
+    for (int cpu : cpus) {
+        if (nodeOf(cpu) != node)
+            return -1;
+    }
+    return node;
+}
+
+void Affinity::apply(const std::string &role, const std::vector<int> &cpus, int memoryNode) {
+#ifdef __linux__
+    // Threads inherit the mask of the (worker pinned) main thread: restore the startup mask
+    // if unset
+    if (!cpus.empty() || (role != "worker" && !workerCpus.empty())) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus.empty() ? startupCpus : cpus) CPU_SET(cpu, &set);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0)
+            logger.warning("Cannot pin the %s thread (error %d)", role, err);
+    }
+
+    // Only worth it (and only meaningful) with more than one node
+    if (memoryNode >= 0 && nodes.size() > 1) {
+        unsigned long mask = 1UL << memoryNode;
+        if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8) != 0)
+            logger.warning("Cannot set the memory policy of the %s thread (errno %d)", role, errno);
+    }
+#else
+    if (!cpus.empty())
+        logger.warning("Thread pinning is not supported on this platform, ignoring %s", role);
+#endif
+}
+
+void Affinity::applyWorkers() {
+    apply("worker", workerCpus, -1);
+}
+
+void Affinity::applySampler() {
+    // The sampler allocates the queued messages the sender consumes
+    apply("sampler", samplerCpus, numaQueues ? nodeOf(senderCpus) : -1);
+}
+
+void Affinity::applySender() {
+    apply("sender", senderCpus, numaQueues ? nodeOf(senderCpus) : -1);
+}
+
+static string describe(const Affinity &affinity, const std::vector<int> &cpus) {
+    if (cpus.empty())
+        return "any CPU";
+    ostringstream out;
+    out << "CPU";
+    for (size_t i = 0; i < cpus.size(); i++) out << (i ? "," : " ") << cpus[i];
+    int node = affinity.nodeOf(cpus);
+    if (node >= 0) out << " (node " << node << ")"; else out << " (several nodes)";
+    return out.str();
+}
+
+void Affinity::report() {
+    ostringstream topology;
+    topology << cpuCount << " CPUs, " << nodes.size() << " NUMA node(s):";
+    for (size_t node = 0; node < nodes.size(); node++) {
+        topology << " node " << node << " has " << nodes[node].size() << " CPUs;";
+    }
+    logger.information("Topology: %s", topology.str());
+    logger.information("Sampler thread on %s", describe(*this, samplerCpus));
+    logger.information("Sender thread on %s", describe(*this, senderCpus));
+    logger.information("Worker threads on %s", describe(*this, workerCpus));
+
+    int queueNode = nodeOf(senderCpus);
+    if (numaQueues && queueNode >= 0 && nodes.size() > 1) {
+        logger.information("Queue memory allocated on node %d", queueNode);
+    } else {
+        logger.information("Queue memory allocated by the default policy");
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef PREDIX_AFFINITY_H
+#define PREDIX_AFFINITY_H
+
+#include "Application.h"
+#include <Poco/Logger.h>
+#include <string>
+#include <vector>
+
+/**
+ * Places the sampler, sender and worker threads on the configured CPUs.
+ *
+ * Configured by the "affinity" section, using Linux cpulist syntax (eg. "0", "2-3,6"). An empty
+ * value (the default) leaves the thread to the OS scheduler:
+ *
+ *   sampler      CPUs of the sampler (or replayer) thread.
+ *   sender       CPUs of the sender thread.
+ *   workers      CPUs of every other thread (logging, metrics, history server). Applied to the
+ *                main thread before they are started, so they inherit it.
+ *   numa_queues  When the sender is pinned, makes both the sampler and the sender allocate
+ *                from the sender's NUMA node, so the queued messages live next to their
+ *                consumer (default true).
+ *
+ * Threads without CPUs of their own get back the mask the process started with, so
+ * restrictions from taskset or a cpuset cgroup are kept. Pinning and memory policies are
+ * only supported on Linux; elsewhere they are logged and ignored.
+ */
+class Affinity {
+
+    // CPUs of each NUMA node, indexed by node id
+    std::vector<std::vector<int>> nodes;
+
+    int cpuCount;
+
+    std::vector<int> samplerCpus;
+
+    std::vector<int> senderCpus;
+
+    std::vector<int> workerCpus;
+
+    // CPUs the process was allowed to run on at startup (eg. by taskset or a cgroup)
+    std::vector<int> startupCpus;
+
+    bool numaQueues;
+
+    Poco::Logger &logger;
+
+    void detectTopology();
+
+    std::vector<int> parseCpus(Configuration &cfg, const std::string &key);
+
+    void apply(const std::string &role, const std::vector<int> &cpus, int memoryNode);
+
+public:
+
+    Affinity(Configuration &cfg);
+
+    /**
+     * Parses a cpulist ("0-3,8"). Throws ERR_GENERIC_EXCEPTION on malformed input.
+     */
+    static std::vector<int> parseCpuList(const std::string &list);
+
+    /**
+     * The NUMA node of 'cpu', 0 when unknown.
+     */
+    int nodeOf(int cpu) const;
+
+    /**
+     * The node all 'cpus' belong to, -1 if they are empty or span several nodes.
+     */
+    int nodeOf(const std::vector<int> &cpus) const;
+
+    // Each must be called from the thread being placed
+    void applyWorkers();
+
+    void applySampler();
+
+    void applySender();
+
+    /**
+     * Logs the detected topology and the chosen placement.
+     */
+    void report();
+};
+
+
+#endif //PREDIX_AFFINITY_H
@@ -0,0 +1,73 @@
+#include "AlertCoalescer.h"
+#include "Metrics.h"
+#include <algorithm>
+
+using namespace std;
+
+AlertCoalescer::AlertCoalescer(Configuration &cfg, size_t sensors, const std::string &message) :
+        message(message), alerts(sensors),
+        samplesMetric(Metrics::instance().get(Metrics::zoned(cfg, "alert.samples"))),
+        recordsMetric(Metrics::instance().get(Metrics::zoned(cfg, "alert.records"))) {
+
+    coalesce = cfg.getBool("alert.coalesce", true);
+    clearSamples = max(1, cfg.getInt("alert.clear_samples", 5));
+    realertMs = cfg.getInt("alert.realert_ms", 10000);
+}
+
+void AlertCoalescer::sample(size_t index, const std::string &sensorId, int64_t timestamp,
+                            double value, bool alarm, std::vector<AssetMessage> &out) {
+    auto &alert = alerts[index];
+    if (alarm) {
+        samplesMetric++;
+        if (alert.count == 0) {
+            alert.firstTimestamp = timestamp;
+            alert.minValue = alert.maxValue = value;
+        }
+        alert.count++;
+        alert.lastTimestamp = timestamp;
+        alert.lastValue = value;
+        alert.minValue = min(alert.minValue, value);
+        alert.maxValue = max(alert.maxValue, value);
+        alert.quietSamples = 0;
+    } else if (alert.count > 0) {
+        alert.quietSamples++;
+    }
+
+    if (alert.count == 0)
+        return;
+    if (!coalesce) {
+        emit(alert, sensorId, out);
+        return;
+    }
+
+    bool cleared = alert.quietSamples >= clearSamples;
+    bool lasting = timestamp - alert.firstTimestamp >= realertMs;
+    if ((cleared || lasting) && timestamp - alert.lastEmitted >= realertMs) {
+        emit(alert, sensorId, out);
+    }
+}
+
+void AlertCoalescer::flush(const std::vector<std::string> &sensorIds, std::vector<AssetMessage> &out) {
+    for (size_t i = 0; i < alerts.size() && i < sensorIds.size(); i++) {
+        if (alerts[i].count > 0)
+            emit(alerts[i], sensorIds[i], out);
+    }
+}
+
+void AlertCoalescer::emit(Alert &alert, const std::string &sensorId, std::vector<AssetMessage> &out) {
+    out.emplace_back();
+    auto &msg = out.back();
+    msg.sensor_id = sensorId;
+    msg.timestamp = alert.lastTimestamp;
+    msg.value = alert.lastValue;
+    msg.message = message;
+    msg.firstTimestamp = alert.firstTimestamp;
+    msg.count = alert.count;
+    msg.minValue = alert.minValue;
+    msg.maxValue = alert.maxValue;
+    recordsMetric++;
+
+    alert.lastEmitted = alert.lastTimestamp;
+    alert.count = 0;
+    alert.quietSamples = 0;
+}
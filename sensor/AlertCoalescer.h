@@ -0,0 +1,77 @@
+#ifndef PREDIX_ALERTCOALESCER_H
+#define PREDIX_ALERTCOALESCER_H
+
+#include "Application.h"
+#include "Messages.h"
+#include <atomic>
+#include <string>
+#include <vector>
+
+/**
+ * Turns the alarm samples of each sensor into asset records, one per burst instead of one
+ * per sample.
+ *
+ * An alert opens on the first alarm sample of a sensor and accumulates the following ones
+ * (first/last timestamp, count, min/max value). It is cleared, with hysteresis, after
+ * "alert.clear_samples" consecutive samples without alarm, and its summary is then emitted.
+ * An alert lasting longer than "alert.realert_ms" is emitted without waiting for it to clear,
+ * and a sensor is never re-alerted sooner than that after its previous record: bursts in
+ * between are merged into the next one.
+ *
+ * "alert.coalesce = false" emits one record per alarm sample, as before.
+ *
+ * Only used from the sampler thread.
+ */
+class AlertCoalescer {
+
+    struct Alert {
+        // Alarm samples accumulated, 0 when there is no pending alert
+        int64_t count = 0;
+        int64_t firstTimestamp;
+        int64_t lastTimestamp;
+        double lastValue;
+        double minValue;
+        double maxValue;
+
+        // Consecutive samples without alarm since the last one
+        int quietSamples = 0;
+
+        // When the previous record of the sensor was emitted
+        int64_t lastEmitted = 0;
+    };
+
+    bool coalesce;
+    int clearSamples;
+    int64_t realertMs;
+
+    std::string message;
+
+    // One per sensor, by index
+    std::vector<Alert> alerts;
+
+    // Exported metrics
+    std::atomic<int64_t> &samplesMetric;
+    std::atomic<int64_t> &recordsMetric;
+
+    void emit(Alert &alert, const std::string &sensorId, std::vector<AssetMessage> &out);
+
+public:
+
+    AlertCoalescer(Configuration &cfg, size_t sensors, const std::string &message);
+
+    /**
+     * Feeds a sample of the sensor at 'index'. Appends to 'out' the records due.
+     */
+    void sample(size_t index, const std::string &sensorId, int64_t timestamp, double value,
+                bool alarm, std::vector<AssetMessage> &out);
+
+    /**
+     * Appends to 'out' the records of every pending alert, ignoring "alert.realert_ms". Called
+     * when sampling stops, so no alarm sample goes unreported. 'sensorIds' are the sensor ids
+     * by index.
+     */
+    void flush(const std::vector<std::string> &sensorIds, std::vector<AssetMessage> &out);
+};
+
+
+#endif //PREDIX_ALERTCOALESCER_H
@@ -7,6 +7,7 @@
 #include <Poco/Net/HTTPSClientSession.h>
 #include <Poco/Net/HTTPSStreamFactory.h>
 #include <Poco/Net/HTTPStreamFactory.h>
+#include <Poco/Net/SSLManager.h>
 #include <Poco/URI.h>
 #include <Poco/File.h>
 #include <Poco/ConsoleChannel.h>
@@ -16,13 +17,33 @@
 #include <string>
 #include <iostream>
 #include "errors.h"
-#include "Sampler.h"
+#include "Zone.h"
+#include "SenderPool.h"
+#include "Metrics.h"
+#include "AsyncLog.h"
+#include "HistoryServer.h"
+#include "Affinity.h"
+#include "Supervisor.h"
+#include "StartupTimeline.h"
+#include "Tracing.h"
 #include <thread>
+#include <memory>
+#include <future>
+#include <csignal>
 
 using namespace std;
 using namespace Poco::Net;
 using namespace Poco;
 
+// How often the main thread checks for a stop signal
+#define STOP_POLL_MS 100
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onStopSignal(int) {
+    stopRequested = 1;
+}
+
 void setupLogging(string level) {
     AutoPtr<ConsoleChannel> console(new ConsoleChannel);
     AutoPtr<PatternFormatter> pattFormatter(new PatternFormatter);
@@ -34,6 +55,8 @@ void setupLogging(string level) {
 
 int Application::main(const std::vector<std::string> &args) {
 
+    auto &timeline = StartupTimeline::instance();
+
     string confdir("conf");
 
     if (args.size() > 0) {
@@ -60,6 +83,39 @@ int Application::main(const std::vector<std::string> &args) {
     loadConfiguration(iniFile.path());
 
     setupLogging(config().getString("logging.loglevel", "information"));
+    timeline.mark("config");
+
+    // Multi-process mode. Workers are forked before any thread is started, and return here
+    // to run as regular sensors on their own shard.
+    unique_ptr<Supervisor> supervisor;
+    int workerIndex = -1;
+    if (config().getInt("supervisor.workers", 0) > 0) {
+        try {
+            supervisor.reset(new Supervisor(config()));
+            workerIndex = supervisor->run();
+        } catch (int err) {
+            return err;
+        }
+        if (workerIndex < 0)
+            return 0;
+        supervisor->configureWorker(workerIndex);
+    }
+
+    // Thread placement. Every thread but the sampler and sender inherits the worker CPUs.
+    Affinity affinity(config());
+    affinity.report();
+    affinity.applyWorkers();
+
+    // Hot path messages are formatted and written by a background thread
+    if (config().getBool("logging.async", true)) {
+        asynclog::start((size_t) config().getInt("logging.ring_size", 8192));
+    }
+
+    // Span tracing of the sender hot path, dumped on SIGUSR1 and at exit
+    if (config().getBool("tracing.enabled", false)) {
+        tracing::start(config().getString("tracing.file", "trace.json"),
+                       (size_t) config().getInt("tracing.buffer_spans", 65536));
+    }
 
     // Setup and initialize SSL
     auto certs = Path(confdir, "ca-certificates.crt").absolute().toString();
@@ -68,23 +124,104 @@ int Application::main(const std::vector<std::string> &args) {
     HTTPStreamFactory::registerFactory();
     HTTPSStreamFactory::registerFactory();
 
-    // Setup sender and sampler objects
-    Sender sender(config());
-    Sampler sampler(config(), sender);
+    // Creating the client context parses the CA bundle once for all connections. It's done in
+    // the background while the rest starts; only the sender waits for it.
+    shared_future<void> sslReady = async(launch::async, [&timeline]() {
+        try {
+            // Lets reconnections resume their TLS sessions
+            SSLManager::instance().defaultClientContext()->enableSessionCache(true);
+        } catch (Poco::Exception &ex) {
+            Logger::get("Application").error("Cannot initialize SSL. Cause: %s", ex.displayText());
+            exit(ERR_GENERIC_EXCEPTION);
+        }
+        timeline.mark("ssl");
+    }).share();
+
+    // Local recent history, served over HTTP when enabled
+    HistoryStore history(config());
+    HistoryServer historyServer(config(), history);
+    historyServer.start();
+
+    // Setup the sender and sampler objects of each zone
+    vector<unique_ptr<Zone>> zones;
+    vector<Sender *> senders;
+    for (auto &name : Zone::names(config())) {
+        zones.emplace_back(new Zone(config(), name, history));
+        senders.push_back(&zones.back()->sender);
+    }
+    SenderPool senderPool(config(), senders);
+
+    // Start a sampling thread for each zone. A configured capture replaces the sampled data.
+    vector<thread> samplerThreads;
+    for (auto &zone : zones) {
+        Zone *z = zone.get();
+        bool replay = z->config().has("replay.file");
+        samplerThreads.emplace_back([z, &affinity, replay]() {
+            affinity.applySampler();
+            tracing::setThreadName("sampler");
+            if (replay) {
+                try {
+                    z->replayer.run();
+                } catch (int err) {
+                    // the replayer already logged the cause
+                    exit(err);
+                }
+            } else {
+                z->sampler.run();
+            }
+        });
+    }
 
-    // Start a thread for each object
-    thread samplerThread([&sampler]() {
-        sampler.run();
+    // The zones share the sender threads
+    vector<thread> senderThreads;
+    for (int i = 0; i < senderPool.threadCount(); i++) {
+        senderThreads.emplace_back([&senderPool, &affinity, sslReady]() {
+            affinity.applySender();
+            tracing::setThreadName("sender");
+            sslReady.wait();
+            senderPool.work();
+        });
+    }
+
+    // Periodically log the metrics (queue usage, drops, ...). 0 disables the report.
+    int metricsInterval = config().getInt("metrics.interval", 60);
+    thread metricsThread([metricsInterval]() {
+        auto &logger = Logger::get("Metrics");
+        while (metricsInterval > 0) {
+            this_thread::sleep_for(chrono::seconds(metricsInterval));
+            Metrics::instance().report(logger);
+        }
     });
 
-    thread senderThread([&sender](){
-        sender.run();
+    // Workers publish their metrics to the supervisor
+    thread statsThread([&supervisor, workerIndex]() {
+        while (supervisor) {
+            this_thread::sleep_for(chrono::seconds(1));
+            supervisor->publish(workerIndex);
+        }
     });
 
-    samplerThread.join();
-    senderThread.join();
+    // Run until SIGINT/SIGTERM. Then the samplers enqueue their pending alerts and the
+    // senders get "shutdown.drain_ms" to send what is queued.
+    signal(SIGINT, onStopSignal);
+    signal(SIGTERM, onStopSignal);
+    while (!stopRequested) {
+        this_thread::sleep_for(chrono::milliseconds(STOP_POLL_MS));
+    }
+
+    Logger::get("Application").information("Stopping");
+    for (size_t i = 0; i < zones.size(); i++) {
+        if (zones[i]->config().has("replay.file")) {
+            samplerThreads[i].detach();
+        } else {
+            zones[i]->sampler.stop();
+            samplerThreads[i].join();
+        }
+    }
+    this_thread::sleep_for(chrono::milliseconds(config().getInt("shutdown.drain_ms", 1000)));
 
-    return 0;
+    // The sender and reporting threads never return
+    exit(0);
 }
 
 POCO_APP_MAIN(Application);
\ No newline at end of file
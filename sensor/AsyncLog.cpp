@@ -0,0 +1,288 @@
+#include "AsyncLog.h"
+#include "Metrics.h"
+#include <Poco/Timestamp.h>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Writer thread sleep when there is nothing to log
+#define WRITER_IDLE_SLEEP_MS 5
+
+using namespace std;
+
+namespace asynclog {
+
+namespace {
+
+/**
+ * Single producer / single consumer ring of records.
+ */
+class Ring {
+    vector<Record> records;
+    size_t mask;
+    atomic<size_t> head;
+    atomic<size_t> tail;
+
+public:
+    Ring(size_t capacity) : records(capacity), mask(capacity - 1), head(0), tail(0) {}
+
+    bool push(const Record &rec) {
+        auto h = head.load(memory_order_relaxed);
+        if (h - tail.load(memory_order_acquire) >= records.size())
+            return false;
+        records[h & mask] = rec;
+        head.store(h + 1, memory_order_release);
+        return true;
+    }
+
+    bool pop(Record &rec) {
+        auto t = tail.load(memory_order_relaxed);
+        if (t == head.load(memory_order_acquire))
+            return false;
+        rec = records[t & mask];
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+};
+
+mutex &ringsMutex = *new mutex();
+
+// Rings are never freed: a thread may exit with records still buffered, and other threads
+// may still log while 'exit' runs the static destructors
+vector<Ring *> &rings = *new vector<Ring *>();
+
+size_t ringCapacity = 0;
+
+atomic<bool> running(false);
+
+thread writer;
+
+thread_local Ring *localRing = nullptr;
+
+int64_t nowMicros() {
+    return chrono::duration_cast<chrono::microseconds>(
+            chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void output(const Record &rec) {
+    auto &site = *rec.site;
+    Poco::Message msg(rec.logger->name(), site.format(rec.args, rec.nargs, rec.suppressed),
+                      site.priority);
+    msg.setTime(Poco::Timestamp(rec.timestamp));
+    rec.logger->log(msg);
+}
+
+// Moves every buffered record out of the rings and logs them in timestamp order.
+bool drain(vector<Record> &pending) {
+    {
+        unique_lock<mutex> lock(ringsMutex);
+        Record rec;
+        for (auto &ring : rings) {
+            while (ring->pop(rec)) pending.push_back(rec);
+        }
+    }
+    if (pending.empty())
+        return false;
+
+    stable_sort(pending.begin(), pending.end(), [](const Record &a, const Record &b) {
+        return a.timestamp < b.timestamp;
+    });
+    for (auto &rec : pending) output(rec);
+    pending.clear();
+    return true;
+}
+
+void writerLoop() {
+    vector<Record> pending;
+    while (running) {
+        if (!drain(pending))
+            this_thread::sleep_for(chrono::milliseconds(WRITER_IDLE_SLEEP_MS));
+    }
+    drain(pending);
+}
+
+bool isIntLetter(char c) {
+    return strchr("di", c) != nullptr;
+}
+
+bool isUIntLetter(char c) {
+    return strchr("ouxX", c) != nullptr;
+}
+
+bool isDoubleLetter(char c) {
+    return strchr("eEfFgGaA", c) != nullptr;
+}
+
+}
+
+Site::Site(Poco::Message::Priority priority, const char *format) : priority(priority) {
+
+    // Split the format in literal runs and conversion specs. Length modifiers are dropped
+    // since arguments are always stored as 64 bit values.
+    string literal;
+    for (const char *p = format; *p; p++) {
+        if (*p != '%') {
+            literal.push_back(*p);
+            continue;
+        }
+        if (p[1] == '%') {
+            literal.push_back('%');
+            p++;
+            continue;
+        }
+
+        string spec("%");
+        const char *q = p + 1;
+        while (*q && strchr("-+ #0123456789.", *q)) spec.push_back(*q++);
+        while (*q && strchr("hlLqjzt", *q)) q++;
+        if (!*q) {
+            literal.append(p);
+            break;
+        }
+
+        char letter = *q;
+        if (isIntLetter(letter)) {
+            spec.append("lld");
+        } else if (letter == 'c') {
+            spec.push_back('c');
+        } else if (isUIntLetter(letter)) {
+            spec.append("ll");
+            spec.push_back(letter);
+        } else if (isDoubleLetter(letter) || letter == 's') {
+            spec.push_back(letter);
+        } else {
+            // Unknown conversion, keep it verbatim
+            literal.append(p, q + 1);
+            p = q;
+            continue;
+        }
+
+        if (!literal.empty()) {
+            segments.push_back({literal, false, 0});
+            literal.clear();
+        }
+        segments.push_back({spec, true, letter});
+        p = q;
+    }
+    if (!literal.empty())
+        segments.push_back({literal, false, 0});
+}
+
+Site::Limiter &Site::limiter(Poco::Logger &logger) {
+    for (auto &limiter : limiters) {
+        auto current = limiter.logger.load(memory_order_acquire);
+        if (current == &logger)
+            return limiter;
+        if (!current) {
+            Poco::Logger *expected = nullptr;
+            if (limiter.logger.compare_exchange_strong(expected, &logger) || expected == &logger)
+                return limiter;
+        }
+    }
+    return limiters[MAX_SITE_LOGGERS - 1];
+}
+
+bool Site::admit(Limiter &limiter, int rate, int sample) {
+    if (rate > 0) {
+        int64_t now = chrono::duration_cast<chrono::milliseconds>(
+                chrono::steady_clock::now().time_since_epoch()).count();
+        if (now - limiter.windowStart.load(memory_order_relaxed) >= 1000) {
+            limiter.windowStart.store(now, memory_order_relaxed);
+            limiter.windowCount.store(0, memory_order_relaxed);
+        }
+        if (limiter.windowCount.fetch_add(1, memory_order_relaxed) >= rate) {
+            limiter.suppressed++;
+            return false;
+        }
+    }
+    if (sample > 1 && limiter.counter.fetch_add(1, memory_order_relaxed) % sample != 0) {
+        limiter.suppressed++;
+        return false;
+    }
+    return true;
+}
+
+std::string Site::format(const Arg *args, int nargs, uint32_t suppressed) const {
+    string text;
+    char buf[128];
+    int i = 0;
+    for (auto &seg : segments) {
+        if (!seg.conversion) {
+            text.append(seg.text);
+            continue;
+        }
+        if (i >= nargs) {
+            text.append("<?>");
+            continue;
+        }
+
+        auto &a = args[i++];
+        const char *spec = seg.text.c_str();
+        if (a.type == Arg::CSTR || seg.letter == 's') {
+            text.append(a.type == Arg::CSTR ? a.s : "<?>");
+            continue;
+        }
+
+        double d = a.type == Arg::DOUBLE ? a.d : a.type == Arg::INT ? (double) a.i : (double) a.u;
+        long long ll = a.type == Arg::DOUBLE ? (long long) a.d : a.type == Arg::INT ? a.i : (long long) a.u;
+        if (isDoubleLetter(seg.letter)) {
+            snprintf(buf, sizeof(buf), spec, d);
+        } else if (seg.letter == 'c') {
+            snprintf(buf, sizeof(buf), spec, (int) ll);
+        } else {
+            snprintf(buf, sizeof(buf), spec, ll);
+        }
+        text.append(buf);
+    }
+
+    if (suppressed) {
+        snprintf(buf, sizeof(buf), " (%u similar messages suppressed)", suppressed);
+        text.append(buf);
+    }
+    return text;
+}
+
+void start(size_t ringSize) {
+    if (running)
+        return;
+
+    // round up to a power of two so the ring index is a mask
+    ringCapacity = 1;
+    while (ringCapacity < ringSize) ringCapacity <<= 1;
+
+    running = true;
+    writer = thread(writerLoop);
+    atexit(stop);
+}
+
+void stop() {
+    if (!running.exchange(false))
+        return;
+    if (writer.joinable())
+        writer.join();
+}
+
+void write(Record &rec) {
+    rec.timestamp = nowMicros();
+    if (!running) {
+        output(rec);
+        return;
+    }
+
+    if (!localRing) {
+        unique_lock<mutex> lock(ringsMutex);
+        rings.push_back(new Ring(ringCapacity));
+        localRing = rings.back();
+    }
+
+    if (!localRing->push(rec)) {
+        static auto &dropped = Metrics::instance().get("log.dropped");
+        dropped++;
+    }
+}
+
+}
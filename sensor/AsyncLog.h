@@ -0,0 +1,194 @@
+#ifndef PREDIX_ASYNCLOG_H
+#define PREDIX_ASYNCLOG_H
+
+#include <Poco/Logger.h>
+#include <Poco/Message.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Asynchronous, low-overhead logging for hot paths.
+ *
+ * Each call site holds a static 'Site' with its priority and a pre-parsed printf style
+ * format. The logger and the rate limit are given on every call, so a statement shared by
+ * several instances (eg. one Sender per zone) logs to each instance's logger and limits
+ * each one separately. Logging a message only copies the site and logger pointers and the
+ * raw arguments into a per-thread ring buffer; a background thread formats the records and
+ * writes them through the regular POCO logger channels.
+ *
+ * Arguments may be integers, floating point numbers or string literals (the pointer is
+ * stored, so the string must outlive the process). Use the macros below:
+ *
+ *   async_debug(logger, "TS: %.5f", value);
+ *   async_debug_rate(logger, 10, "TS: %.5f", value);     // at most 10 messages/second
+ *   async_debug_sampled(logger, 100, "TS: %.5f", value); // one out of 100 messages
+ *
+ * Until 'start' is called (or if logging.async is disabled) messages are formatted and
+ * logged synchronously.
+ */
+namespace asynclog {
+
+// Maximum number of arguments per message
+const int MAX_ARGS = 4;
+
+struct Arg {
+    enum Type : uint8_t {
+        INT, UINT, DOUBLE, CSTR
+    };
+
+    Type type;
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+        const char *s;
+    };
+};
+
+// Loggers a site rate limits separately. Any further logger shares the last limiter.
+const int MAX_SITE_LOGGERS = 8;
+
+/**
+ * A log statement location. Sites are never destroyed: records may still reference them
+ * while the process exits.
+ */
+class Site {
+public:
+    // A literal run of the format string or a single conversion spec
+    struct Segment {
+        std::string text;
+        bool conversion;
+        char letter;
+    };
+
+    // Rate limiting / sampling state of one logger
+    struct Limiter {
+        std::atomic<Poco::Logger *> logger;
+        std::atomic<int64_t> windowStart;
+        std::atomic<int> windowCount;
+        std::atomic<int64_t> counter;
+        std::atomic<uint32_t> suppressed;
+
+        Limiter() : logger(nullptr), windowStart(0), windowCount(0), counter(0), suppressed(0) {}
+    };
+
+    Poco::Message::Priority priority;
+    std::vector<Segment> segments;
+
+    Limiter limiters[MAX_SITE_LOGGERS];
+
+    Site(Poco::Message::Priority priority, const char *format);
+
+    // The limiter of 'logger' at this site
+    Limiter &limiter(Poco::Logger &logger);
+
+    /**
+     * Applies rate limiting (at most 'rate' messages per second) and sampling (one out of
+     * 'sample' messages). Zero disables either. Returns false if the message should be
+     * skipped.
+     */
+    static bool admit(Limiter &limiter, int rate, int sample);
+
+    std::string format(const Arg *args, int nargs, uint32_t suppressed) const;
+};
+
+struct Record {
+    const Site *site;
+    Poco::Logger *logger;
+    int64_t timestamp;
+    uint32_t suppressed;
+    uint8_t nargs;
+    Arg args[MAX_ARGS];
+};
+
+/**
+ * Starts the background writer thread. 'ringSize' is the number of records each logging
+ * thread can buffer; messages are dropped (and counted) when a ring is full.
+ */
+void start(size_t ringSize);
+
+/**
+ * Writes out every buffered record and stops the writer thread. Registered with 'atexit'
+ * by 'start'. Records buffered afterwards (eg. by threads still running while another one
+ * calls 'exit') are not written, but the rings stay valid.
+ */
+void stop();
+
+/**
+ * Buffers (or logs synchronously, if not started) a record. Use the macros instead.
+ */
+void write(Record &rec);
+
+inline Arg arg(int v) { Arg a; a.type = Arg::INT; a.i = v; return a; }
+inline Arg arg(long v) { Arg a; a.type = Arg::INT; a.i = v; return a; }
+inline Arg arg(long long v) { Arg a; a.type = Arg::INT; a.i = v; return a; }
+inline Arg arg(unsigned v) { Arg a; a.type = Arg::UINT; a.u = v; return a; }
+inline Arg arg(unsigned long v) { Arg a; a.type = Arg::UINT; a.u = v; return a; }
+inline Arg arg(unsigned long long v) { Arg a; a.type = Arg::UINT; a.u = v; return a; }
+inline Arg arg(double v) { Arg a; a.type = Arg::DOUBLE; a.d = v; return a; }
+inline Arg arg(const char *v) { Arg a; a.type = Arg::CSTR; a.s = v; return a; }
+
+inline void fill(Record &) {}
+
+template<typename T, typename... Rest>
+inline void fill(Record &rec, const T &value, const Rest &... rest) {
+    static_assert(sizeof...(Rest) < MAX_ARGS, "Too many async log arguments");
+    rec.args[rec.nargs++] = arg(value);
+    fill(rec, rest...);
+}
+
+inline const char *formatOf(const char *format) {
+    return format;
+}
+
+template<typename... Args>
+inline const char *formatOf(const char *format, const Args &...) {
+    return format;
+}
+
+template<typename... Args>
+void log(Site &site, Poco::Logger &logger, int rate, int sample, const char *,
+         const Args &... args) {
+    uint32_t suppressed = 0;
+    if (rate > 0 || sample > 1) {
+        auto &limiter = site.limiter(logger);
+        if (!Site::admit(limiter, rate, sample))
+            return;
+        suppressed = limiter.suppressed.exchange(0);
+    }
+    Record rec;
+    rec.site = &site;
+    rec.logger = &logger;
+    rec.nargs = 0;
+    rec.suppressed = suppressed;
+    fill(rec, args...);
+    write(rec);
+}
+
+}
+
+#define ASYNC_LOG_IMPL(logger, priority, rate, sample, ...) \
+    do { \
+        Poco::Logger &_async_log_logger = (logger); \
+        if (_async_log_logger.is(priority)) { \
+            static asynclog::Site &_async_log_site = \
+                    *new asynclog::Site(priority, asynclog::formatOf(__VA_ARGS__)); \
+            asynclog::log(_async_log_site, _async_log_logger, rate, sample, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define async_debug(logger, ...) \
+    ASYNC_LOG_IMPL(logger, Poco::Message::PRIO_DEBUG, 0, 0, __VA_ARGS__)
+
+#define async_debug_rate(logger, perSecond, ...) \
+    ASYNC_LOG_IMPL(logger, Poco::Message::PRIO_DEBUG, perSecond, 0, __VA_ARGS__)
+
+#define async_debug_sampled(logger, oneOutOf, ...) \
+    ASYNC_LOG_IMPL(logger, Poco::Message::PRIO_DEBUG, 0, oneOutOf, __VA_ARGS__)
+
+#define async_information(logger, ...) \
+    ASYNC_LOG_IMPL(logger, Poco::Message::PRIO_INFORMATION, 0, 0, __VA_ARGS__)
+
+#endif //PREDIX_ASYNCLOG_H
@@ -0,0 +1,79 @@
+#include "BatchController.h"
+#include "Metrics.h"
+#include "errors.h"
+#include <algorithm>
+
+using namespace std;
+
+BatchController::BatchController(Configuration &cfg) :
+        sizeMetric(Metrics::instance().get(Metrics::zoned(cfg, "batch.size"))),
+        lingerMetric(Metrics::instance().get(Metrics::zoned(cfg, "batch.linger_ms"))),
+        rttMetric(Metrics::instance().get(Metrics::zoned(cfg, "batch.rtt_ms"))),
+        decreaseMetric(Metrics::instance().get(Metrics::zoned(cfg, "batch.decreases"))) {
+
+    string name = cfg.getString("batch.mode", "adaptive");
+    if (name == "adaptive") {
+        mode = ADAPTIVE;
+    } else if (name == "fixed") {
+        mode = FIXED;
+    } else {
+        Poco::Logger::get("BatchController").error("Invalid batch.mode: %s", name);
+        throw ERR_GENERIC_EXCEPTION;
+    }
+
+    // Fixed batches are unbounded (zero) by default
+    size = cfg.getDouble("batch.size", mode == ADAPTIVE ? 500 : 0);
+    minSize = cfg.getDouble("batch.min_size", 50);
+    maxSize = cfg.getDouble("batch.max_size", 20000);
+    increase = cfg.getDouble("batch.increase", 100);
+    linger = cfg.getInt("batch.linger_ms", 100);
+    minLinger = cfg.getInt("batch.min_linger_ms", 5);
+    maxLinger = cfg.getInt("batch.max_linger_ms", 100);
+    targetRtt = cfg.getInt("batch.target_rtt_ms", 2000);
+
+    if (mode == ADAPTIVE) {
+        size = max(minSize, min(maxSize, size));
+        linger = max(minLinger, min(maxLinger, linger));
+    }
+    publish();
+}
+
+void BatchController::publish() {
+    sizeMetric = (int64_t) size;
+    lingerMetric = linger;
+}
+
+void BatchController::onAck(size_t points, int64_t rttMs) {
+    rttMetric = rttMs;
+    if (mode == FIXED)
+        return;
+
+    bool full = points >= (size_t) size;
+    if (rttMs > targetRtt) {
+        // multiplicative decrease, the endpoint is struggling
+        size = max(minSize, size / 2);
+        decreaseMetric++;
+    } else if (full) {
+        // additive increase, only when the batch size was actually the limit
+        size = min(maxSize, size + increase);
+    }
+
+    // A full batch means there's a backlog, so dispatch sooner. Otherwise give the queue
+    // some more time to fill.
+    if (full) {
+        linger = max(minLinger, linger / 2);
+    } else {
+        linger = min(maxLinger, linger + minLinger);
+    }
+    publish();
+}
+
+void BatchController::onError() {
+    if (mode == FIXED)
+        return;
+
+    size = max(minSize, size / 2);
+    linger = maxLinger;
+    decreaseMetric++;
+    publish();
+}
@@ -0,0 +1,76 @@
+#ifndef PREDIX_BATCHCONTROLLER_H
+#define PREDIX_BATCHCONTROLLER_H
+
+#include "Application.h"
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Decides how many timeseries points go in each batch and how long the sender lingers
+ * between batches.
+ *
+ * In "adaptive" mode (the default) an AIMD controller tunes both from the measured ack
+ * round-trip time: while acks come back under "batch.target_rtt_ms" the batch grows by a
+ * fixed step, and it is halved when an ack is slow or a batch fails. Linger time shrinks when
+ * batches are full (the sender is falling behind) and grows back when they are not.
+ *
+ * The "fixed" mode always uses "batch.size" and "batch.linger_ms", for benchmarks. Unless
+ * "batch.size" is given, fixed batches are unbounded: every queued point is sent at once.
+ *
+ * Only used from the sender thread.
+ */
+class BatchController {
+public:
+    enum Mode {
+        FIXED,
+        ADAPTIVE
+    };
+
+private:
+    Mode mode;
+
+    double size;
+    double minSize;
+    double maxSize;
+    double increase;
+
+    int64_t linger;
+    int64_t minLinger;
+    int64_t maxLinger;
+
+    int64_t targetRtt;
+
+    // Exported metrics
+    std::atomic<int64_t> &sizeMetric;
+    std::atomic<int64_t> &lingerMetric;
+    std::atomic<int64_t> &rttMetric;
+    std::atomic<int64_t> &decreaseMetric;
+
+    void publish();
+
+public:
+
+    BatchController(Configuration &cfg);
+
+    Mode getMode() const { return mode; }
+
+    // Maximum number of points in the next batch
+    size_t batchSize() const { return size > 0 ? (size_t) size : SIZE_MAX; }
+
+    // Time to sleep before the next dispatch
+    int64_t lingerMs() const { return linger; }
+
+    /**
+     * Feeds back a successful batch of 'points' acked after 'rttMs'.
+     */
+    void onAck(size_t points, int64_t rttMs);
+
+    /**
+     * Feeds back a failed batch.
+     */
+    void onError();
+};
+
+
+#endif //PREDIX_BATCHCONTROLLER_H
@@ -0,0 +1,240 @@
+#include "Capture.h"
+#include "errors.h"
+#include <Poco/Logger.h>
+#include <cstring>
+
+// Encoded records are handed to the flusher thread when the buffer grows over this size
+#define CAPTURE_BUFFER_BYTES (256 * 1024)
+
+// Buffers the flusher may fall behind before writers wait for it
+#define CAPTURE_MAX_PENDING 16
+
+using namespace std;
+
+namespace capture {
+
+static inline void putVarint(string &buf, uint64_t v) {
+    while (v >= 0x80) {
+        buf.push_back((char) (v | 0x80));
+        v >>= 7;
+    }
+    buf.push_back((char) v);
+}
+
+static inline void putDouble(string &buf, double v) {
+    char raw[sizeof(double)];
+    memcpy(raw, &v, sizeof(double));
+    buf.append(raw, sizeof(double));
+}
+
+static inline uint64_t zigzag(int64_t v) {
+    return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v) {
+    return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+Writer::Writer(const std::string &path) {
+    out.open(path, ios::out | ios::binary | ios::trunc);
+    if (!out) {
+        Poco::Logger::get("Capture").error("Cannot create capture file: %s", path);
+        throw ERR_GENERIC_EXCEPTION;
+    }
+    out.write(CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+    buffer.reserve(CAPTURE_BUFFER_BYTES * 2);
+    flusher = thread(&Writer::flushLoop, this);
+}
+
+Writer::~Writer() {
+    {
+        unique_lock<mutex> lock(writeMutex);
+        if (!buffer.empty())
+            handOff(lock);
+        stopping = true;
+    }
+    pendingChanged.notify_all();
+    flusher.join();
+}
+
+uint32_t Writer::intern(const std::string &str) {
+    auto it = dictionary.find(str);
+    if (it != dictionary.end())
+        return it->second;
+
+    auto id = (uint32_t) dictionary.size();
+    dictionary.emplace(str, id);
+    buffer.push_back((char) OP_TAG);
+    putVarint(buffer, str.size());
+    buffer.append(str);
+    return id;
+}
+
+void Writer::writeHeader(Opcode op, const std::string &tag, int64_t timestamp, double value) {
+    auto id = intern(tag);
+    buffer.push_back((char) op);
+    putVarint(buffer, id);
+    putVarint(buffer, zigzag(timestamp - lastTimestamp));
+    lastTimestamp = timestamp;
+    putDouble(buffer, value);
+}
+
+void Writer::writeTimeseries(const std::string &tagname, int64_t timestamp, double value) {
+    unique_lock<mutex> lock(writeMutex);
+    writeHeader(OP_TS, tagname, timestamp, value);
+    if (buffer.size() > CAPTURE_BUFFER_BYTES)
+        handOff(lock);
+}
+
+void Writer::writeAsset(const std::string &sensorId, int64_t timestamp, double value,
+                        const std::string &message) {
+    unique_lock<mutex> lock(writeMutex);
+    // the message must be in the dictionary before the record referencing it
+    auto msgId = intern(message);
+    writeHeader(OP_ASSET, sensorId, timestamp, value);
+    putVarint(buffer, msgId);
+    if (buffer.size() > CAPTURE_BUFFER_BYTES)
+        handOff(lock);
+}
+
+void Writer::writeAlert(const std::string &sensorId, int64_t timestamp, double value,
+                        const std::string &message, int64_t firstTimestamp, int64_t count,
+                        double minValue, double maxValue) {
+    unique_lock<mutex> lock(writeMutex);
+    auto msgId = intern(message);
+    writeHeader(OP_ALERT, sensorId, timestamp, value);
+    putVarint(buffer, msgId);
+    putVarint(buffer, (uint64_t) (timestamp - firstTimestamp));
+    putVarint(buffer, (uint64_t) count);
+    putDouble(buffer, minValue);
+    putDouble(buffer, maxValue);
+    if (buffer.size() > CAPTURE_BUFFER_BYTES)
+        handOff(lock);
+}
+
+void Writer::handOff(std::unique_lock<std::mutex> &lock) {
+    // Bounds the memory held while the disk is stalled
+    pendingChanged.wait(lock, [this]() { return pending.size() < CAPTURE_MAX_PENDING; });
+    pending.push_back(move(buffer));
+    buffer = string();
+    buffer.reserve(CAPTURE_BUFFER_BYTES * 2);
+    pendingChanged.notify_all();
+}
+
+void Writer::flushLoop() {
+    unique_lock<mutex> lock(writeMutex);
+    for (;;) {
+        pendingChanged.wait(lock, [this]() { return !pending.empty() || stopping; });
+        if (pending.empty())
+            return;
+
+        // Write without the lock, so records keep being encoded meanwhile
+        string chunk = move(pending.front());
+        lock.unlock();
+        out.write(chunk.data(), chunk.size());
+        out.flush();
+        if (!out) {
+            Poco::Logger::get("Capture").error("Error writing the capture file");
+            out.clear();
+        }
+        lock.lock();
+        pending.pop_front();
+        pendingChanged.notify_all();
+    }
+}
+
+void Writer::flush() {
+    unique_lock<mutex> lock(writeMutex);
+    if (!buffer.empty())
+        handOff(lock);
+}
+
+Reader::Reader(const char *data, size_t size) : pos(data), end(data + size) {
+    if (size < sizeof(CAPTURE_MAGIC) || memcmp(data, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0) {
+        Poco::Logger::get("Capture").error("Invalid capture file header.");
+        throw ERR_GENERIC_EXCEPTION;
+    }
+    pos += sizeof(CAPTURE_MAGIC);
+}
+
+bool Reader::readVarint(uint64_t &v) {
+    v = 0;
+    for (int shift = 0; pos < end && shift < 64; shift += 7) {
+        uint8_t b = (uint8_t) *pos++;
+        v |= (uint64_t) (b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    // Truncated record. Make sure the caller stops reading.
+    pos = end;
+    return false;
+}
+
+bool Reader::readDouble(double &v) {
+    if ((size_t) (end - pos) < sizeof(double)) {
+        pos = end;
+        return false;
+    }
+    memcpy(&v, pos, sizeof(double));
+    pos += sizeof(double);
+    return true;
+}
+
+const std::string *Reader::lookup(uint64_t id) {
+    if (id >= dictionary.size()) {
+        Poco::Logger::get("Capture").error("Corrupted capture: unknown string id %d", (int) id);
+        throw ERR_GENERIC_EXCEPTION;
+    }
+    return &dictionary[id];
+}
+
+bool Reader::next(Record &rec) {
+    uint64_t v;
+    while (pos < end) {
+        auto op = (Opcode) *pos++;
+        if (op == OP_TAG) {
+            if (!readVarint(v) || (size_t) (end - pos) < v)
+                return false;
+            dictionary.emplace_back(pos, (size_t) v);
+            pos += v;
+            continue;
+        } else if (op != OP_TS && op != OP_ASSET && op != OP_ALERT) {
+            Poco::Logger::get("Capture").error("Corrupted capture: unknown opcode %d", (int) op);
+            throw ERR_GENERIC_EXCEPTION;
+        }
+
+        rec.type = op;
+        if (!readVarint(v))
+            return false;
+        rec.tag = lookup(v);
+        if (!readVarint(v))
+            return false;
+        lastTimestamp += unzigzag(v);
+        rec.timestamp = lastTimestamp;
+        if (!readDouble(rec.value))
+            return false;
+        rec.message = nullptr;
+        if (op != OP_TS) {
+            if (!readVarint(v))
+                return false;
+            rec.message = lookup(v);
+        }
+        rec.firstTimestamp = rec.timestamp;
+        rec.count = 1;
+        rec.minValue = rec.maxValue = rec.value;
+        if (op == OP_ALERT) {
+            if (!readVarint(v))
+                return false;
+            rec.firstTimestamp -= (int64_t) v;
+            if (!readVarint(v))
+                return false;
+            rec.count = (int64_t) v;
+            if (!readDouble(rec.minValue) || !readDouble(rec.maxValue))
+                return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+}
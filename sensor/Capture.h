@@ -0,0 +1,159 @@
+#ifndef PREDIX_CAPTURE_H
+#define PREDIX_CAPTURE_H
+
+#include <string>
+#include <deque>
+#include <unordered_map>
+#include <fstream>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+
+/**
+ * Compact binary capture format for sensor streams.
+ *
+ * A capture file starts with the 8 byte CAPTURE_MAGIC header followed by a sequence of
+ * records, each one starting with a single opcode byte:
+ *
+ *   TAG    varint length, bytes          Adds a string to the dictionary. Ids are sequential.
+ *   TS     varint tag, svarint dt, f64   A timeseries point.
+ *   ASSET  varint tag, svarint dt, f64,  An asset message. Tag and message are both
+ *          varint message                dictionary ids.
+ *   ALERT  ASSET fields, varint span,    An asset message summarizing 'count' alarm samples,
+ *          varint count, f64 min,        taken from timestamp - span to timestamp.
+ *          f64 max
+ *
+ * Timestamps are zig-zag encoded deltas from the previous point/asset record, so a steady
+ * stream costs a couple of bytes per timestamp. Doubles are stored in host (little-endian)
+ * byte order.
+ */
+namespace capture {
+
+const char CAPTURE_MAGIC[8] = {'P', 'S', 'C', 'A', 'P', '0', '1', '\n'};
+
+enum Opcode : uint8_t {
+    OP_TAG = 1,
+    OP_TS = 2,
+    OP_ASSET = 3,
+    OP_ALERT = 4
+};
+
+// A decoded capture record. Strings point into the reader dictionary. An ASSET record is
+// read as an alert of a single sample.
+struct Record {
+    Opcode type;
+    const std::string *tag;
+    const std::string *message;
+    int64_t timestamp;
+    double value;
+    int64_t firstTimestamp;
+    int64_t count;
+    double minValue;
+    double maxValue;
+};
+
+/**
+ * Appends records to a capture file.
+ *
+ * Records are encoded into an in-memory buffer. Full buffers are written out in large chunks
+ * by a background thread, so callers don't wait for the disk unless it falls several buffers
+ * behind. This class is thread-safe.
+ */
+class Writer {
+
+    std::ofstream out;
+
+    // Encoded records not yet handed to the flusher thread
+    std::string buffer;
+
+    // Dictionary of strings already written to the file
+    std::unordered_map<std::string, uint32_t> dictionary;
+
+    int64_t lastTimestamp = 0;
+
+    std::mutex writeMutex;
+
+    // Buffers waiting to be written, oldest first
+    std::deque<std::string> pending;
+
+    // Signaled when a buffer is handed over or written
+    std::condition_variable pendingChanged;
+
+    bool stopping = false;
+
+    std::thread flusher;
+
+    uint32_t intern(const std::string &str);
+
+    void writeHeader(Opcode op, const std::string &tag, int64_t timestamp, double value);
+
+    // Hands 'buffer' to the flusher thread. Must be called with 'writeMutex' held.
+    void handOff(std::unique_lock<std::mutex> &lock);
+
+    void flushLoop();
+
+public:
+
+    /**
+     * Opens (truncates) the capture file. Throws ERR_GENERIC_EXCEPTION if the file cannot
+     * be created.
+     */
+    Writer(const std::string &path);
+
+    ~Writer();
+
+    void writeTimeseries(const std::string &tagname, int64_t timestamp, double value);
+
+    void writeAsset(const std::string &sensorId, int64_t timestamp, double value,
+                    const std::string &message);
+
+    void writeAlert(const std::string &sensorId, int64_t timestamp, double value,
+                    const std::string &message, int64_t firstTimestamp, int64_t count,
+                    double minValue, double maxValue);
+
+    // Hands the buffered records to the flusher thread, without waiting for the write.
+    void flush();
+};
+
+/**
+ * Decodes records from an in-memory capture (usually a memory-mapped file).
+ *
+ * Not thread-safe.
+ */
+class Reader {
+
+    const char *pos;
+    const char *end;
+
+    // Strings decoded so far. A deque keeps references stable while it grows.
+    std::deque<std::string> dictionary;
+
+    int64_t lastTimestamp = 0;
+
+    // Decodes a varint into 'v'. Returns false if the capture ends before it does.
+    bool readVarint(uint64_t &v);
+
+    bool readDouble(double &v);
+
+    const std::string *lookup(uint64_t id);
+
+public:
+
+    /**
+     * Starts reading the capture at 'data'. Throws ERR_GENERIC_EXCEPTION if the header is
+     * invalid.
+     */
+    Reader(const char *data, size_t size);
+
+    /**
+     * Decodes the next TS, ASSET or ALERT record into 'rec'. Dictionary records are consumed
+     * transparently. Returns false at end of capture, or at a record truncated by the end of
+     * the capture.
+     */
+    bool next(Record &rec);
+};
+
+}
+
+#endif //PREDIX_CAPTURE_H
@@ -13,6 +13,9 @@
 #include <Poco/Net/HTMLForm.h>
 #include <Poco/Net/HTTPBasicCredentials.h>
 #include <iostream>
+#include <limits>
+#include <Poco/Logger.h>
+#include "errors.h"
 
 using namespace std;
 using namespace Poco::Net;
@@ -43,14 +46,27 @@ void HTTPClient::setTimeout(uint64_t timeout) {
     this->timeout = timeout;
 }
 
-HTTPClient::Response HTTPClient::post() {
+void HTTPClient::setSessionPool(HTTPSessionPool *pool) {
+    this->pool = pool;
+}
+
+HTTPClient::Response HTTPClient::post(const BodyHandler &handler) {
+    return execute(HTTPRequest::HTTP_POST, handler);
+}
+
+HTTPClient::Response HTTPClient::get(const BodyHandler &handler) {
+    return execute(HTTPRequest::HTTP_GET, handler);
+}
+
+HTTPClient::Response HTTPClient::execute(const std::string &method, const BodyHandler &handler) {
     const Poco::URI uri(this->uri);
 
     string path = uri.getPathAndQuery();
     string host = uri.getHost();
     uint16_t port = uri.getPort();
+    string scheme = uri.getScheme();
 
-    HTTPRequest req(Poco::Net::HTTPRequest::HTTP_POST, path, Poco::Net::HTTPRequest::HTTP_1_1);
+    HTTPRequest req(method, path, Poco::Net::HTTPRequest::HTTP_1_1);
     HTTPResponse res;
 
     // set headers
@@ -63,32 +79,44 @@ HTTPClient::Response HTTPClient::post() {
         HTTPBasicCredentials cred(basicAuth.first, basicAuth.second);
         cred.authenticate(req);
     }
-    req.setContentLength(requestBody.length());
+    if (method != HTTPRequest::HTTP_GET || !requestBody.empty())
+        req.setContentLength(requestBody.length());
+    req.setKeepAlive(pool != nullptr);
+
     std::ostringstream bodystream;
-    HTTPClientSession* session;
+    unique_ptr<HTTPClientSession> session;
     Response r;
     try {
-        if (uri.getScheme() == "http") {
-            session = new HTTPClientSession(host, port);
+        if (pool) {
+            session = pool->acquire(scheme, host, port);
+        } else if (scheme == "http") {
+            session.reset(new HTTPClientSession(host, port));
         } else {
-            session = new HTTPSClientSession(host, port);
+            session.reset(new HTTPSClientSession(host, port));
         }
 
         if (timeout) session->setTimeout(Poco::Timespan(0, timeout * 1000));
-        auto s = bodystream.str();
         session->sendRequest(req) << requestBody;
-        bodystream << session->receiveResponse(res).rdbuf();
+        auto &body = session->receiveResponse(res);
         r.status_code = res.getStatus();
         r.error_message = res.getReason();
-        r.text = bodystream.str();
+        if (handler && r.status_code >= 200 && r.status_code <= 299) {
+            handler(body);
+            // the whole body must be consumed before the connection is reused
+            body.ignore(numeric_limits<streamsize>::max());
+        } else {
+            bodystream << body.rdbuf();
+            r.text = bodystream.str();
+        }
         r.error_code = OK;
         for (auto it = res.begin(); it != res.end(); it++)
             r.headers[it->first] = it->second;
 
-        delete session;
+        if (pool && res.getKeepAlive())
+            pool->release(scheme, host, port, move(session));
 
     } catch (Poco::Exception ex) {
-        if (ex.className() == "TimeoutException") {
+        if (string(ex.className()) == "TimeoutException") {
             r.error_code = ErrorCode::TIMEOUT_ERROR;
         } else {
             r.error_code = ErrorCode::UNKNOWN_ERROR;
@@ -100,6 +128,36 @@ HTTPClient::Response HTTPClient::post() {
     return std::move(r);
 }
 
+void HTTPClient::validateResponse(const Response &r) {
+    typedef HTTPClient::ErrorCode E;
+
+    auto err = r.error_code;
+
+    if (err == E::OK) {
+        int status = r.status_code;
+
+        if (status >= 200 && status <= 299) {
+            return;
+        } else if (status == 401 || status == 403) {
+            throw ERR_INVALID_CREDENTIALS;
+        } else if (status >= 400 && status <= 499) {
+            throw ERR_INVALID_REQUEST;
+        } else if (status >= 500 && status <= 599) {
+            throw ERR_SERVER_ERROR;
+        } else {
+            Poco::Logger::get("HTTPClient").error("Unknown HTTP status: %d", status);
+            throw ERR_GENERIC_EXCEPTION;
+        }
+    } else if (err == E::GENERIC_SSL_ERROR) {
+        // Some errors that are known to be unrecoverable.
+        Poco::Logger::get("HTTPClient").error("Unrecoverable connection error: %s", r.error_message);
+        throw ERR_GENERIC_EXCEPTION;
+    } else {
+        // Connection errors should be recoverable after a while
+        throw ERR_CONNECTION_ERROR;
+    }
+}
+
 void FormBody::set(string key, string value) {
     formParams[key] = value;
 }
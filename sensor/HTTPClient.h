@@ -8,6 +8,9 @@
 #include <string>
 #include <unordered_map>
 #include <memory>
+#include <functional>
+#include <istream>
+#include "HTTPSessionPool.h"
 
 /**
  * Simple wrapper around POCO::Net HTTP library.
@@ -27,6 +30,8 @@ class HTTPClient {
 
     uint64_t timeout = 0;
 
+    HTTPSessionPool *pool = nullptr;
+
 public:
 
     static const std::string CT_JSON;
@@ -44,6 +49,11 @@ public:
 
     void setTimeout(uint64_t timeout);
 
+    /**
+     * Reuse keep-alive connections from the given pool instead of opening a new one.
+     */
+    void setSessionPool(HTTPSessionPool *pool);
+
     enum ErrorCode {
         OK = 0,
         GENERIC_SSL_ERROR = 1,
@@ -60,7 +70,24 @@ public:
         ErrorCode error_code;
     };
 
-    Response post();
+    /**
+     * Receives the body of a 2xx response as a stream, instead of buffering it in
+     * Response::text.
+     */
+    typedef std::function<void(std::istream &)> BodyHandler;
+
+    Response post(const BodyHandler &handler = nullptr);
+
+    Response get(const BodyHandler &handler = nullptr);
+
+    /**
+     * Throws the matching error code (see errors.h) if the response is not a 2xx.
+     */
+    static void validateResponse(const Response &r);
+
+private:
+
+    Response execute(const std::string &method, const BodyHandler &handler);
 };
 
 class FormBody {
@@ -0,0 +1,39 @@
+#include "HTTPSessionPool.h"
+#include <Poco/Net/HTTPSClientSession.h>
+
+using namespace std;
+using namespace Poco::Net;
+
+static string poolKey(const std::string &scheme, const std::string &host, uint16_t port) {
+    return scheme + "://" + host + ":" + to_string(port);
+}
+
+HTTPSessionPool::SessionPtr HTTPSessionPool::acquire(const std::string &scheme,
+                                                     const std::string &host, uint16_t port) {
+    {
+        unique_lock<mutex> lock(poolMutex);
+        auto &sessions = idle[poolKey(scheme, host, port)];
+        if (!sessions.empty()) {
+            auto session = move(sessions.back());
+            sessions.pop_back();
+            return session;
+        }
+    }
+
+    SessionPtr session;
+    if (scheme == "http") {
+        session.reset(new HTTPClientSession(host, port));
+    } else {
+        session.reset(new HTTPSClientSession(host, port));
+    }
+    session->setKeepAlive(true);
+    return session;
+}
+
+void HTTPSessionPool::release(const std::string &scheme, const std::string &host, uint16_t port,
+                              SessionPtr session) {
+    unique_lock<mutex> lock(poolMutex);
+    auto &sessions = idle[poolKey(scheme, host, port)];
+    if (sessions.size() < maxIdle)
+        sessions.push_back(move(session));
+}
@@ -0,0 +1,45 @@
+#ifndef PREDIX_HTTPSESSIONPOOL_H
+#define PREDIX_HTTPSESSIONPOOL_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <Poco/Net/HTTPClientSession.h>
+
+/**
+ * Pool of idle keep-alive HTTP(S) sessions, keyed by scheme, host and port.
+ *
+ * Reusing a session skips the TCP and TLS handshakes of a new connection. This class is
+ * thread-safe; a session is used by a single thread between 'acquire' and 'release'.
+ */
+class HTTPSessionPool {
+
+    typedef std::unique_ptr<Poco::Net::HTTPClientSession> SessionPtr;
+
+    std::mutex poolMutex;
+
+    std::unordered_map<std::string, std::vector<SessionPtr>> idle;
+
+    // Maximum idle sessions kept per host
+    size_t maxIdle;
+
+public:
+
+    HTTPSessionPool(size_t maxIdle = 8) : maxIdle(maxIdle) {};
+
+    /**
+     * Returns an idle session to the given endpoint or a new (not yet connected) one.
+     */
+    SessionPtr acquire(const std::string &scheme, const std::string &host, uint16_t port);
+
+    /**
+     * Returns a session to the pool after a complete request/response exchange.
+     */
+    void release(const std::string &scheme, const std::string &host, uint16_t port,
+                 SessionPtr session);
+};
+
+
+#endif //PREDIX_HTTPSESSIONPOOL_H
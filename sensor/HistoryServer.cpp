@@ -0,0 +1,166 @@
+#include "HistoryServer.h"
+#include "Metrics.h"
+#include <Poco/Net/HTTPRequestHandler.h>
+#include <Poco/Net/HTTPRequestHandlerFactory.h>
+#include <Poco/Net/HTTPServerParams.h>
+#include <Poco/Net/HTTPServerRequest.h>
+#include <Poco/Net/HTTPServerResponse.h>
+#include <Poco/Net/ServerSocket.h>
+#include <Poco/Net/SocketAddress.h>
+#include <Poco/Net/HTMLForm.h>
+#include <Poco/NumberParser.h>
+#include <Poco/URI.h>
+#include <nlohmann/json.hpp>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+using namespace nlohmann;
+using namespace Poco::Net;
+
+namespace {
+
+class QueryHandler : public HTTPRequestHandler {
+
+    HistoryStore &store;
+
+    void send(HTTPServerResponse &res, HTTPResponse::HTTPStatus status, const string &body) {
+        res.setStatus(status);
+        res.setContentType("application/json");
+        res.setContentLength(body.size());
+        res.send() << body;
+    }
+
+    int64_t param(const HTMLForm &form, const string &name, int64_t defaultValue) {
+        if (!form.has(name))
+            return defaultValue;
+        return Poco::NumberParser::parse64(form.get(name));
+    }
+
+public:
+
+    QueryHandler(HistoryStore &store) : store(store) {}
+
+    void handleRequest(HTTPServerRequest &req, HTTPServerResponse &res) override {
+        string path = Poco::URI(req.getURI()).getPath();
+        HTMLForm form(req);
+
+        if (path == "/tags") {
+            json body = json::array();
+            for (auto &tag : store.tags()) body.push_back(tag);
+            send(res, HTTPResponse::HTTP_OK, body.dump());
+            return;
+        }
+
+        if (path == "/metrics") {
+            json body = json::object();
+            for (auto &item : Metrics::instance().snapshot()) body[item.first] = item.second;
+            send(res, HTTPResponse::HTTP_OK, body.dump());
+            return;
+        }
+
+        if (path != "/range" && path != "/aggregate") {
+            send(res, HTTPResponse::HTTP_NOT_FOUND, "{\"error\": \"not found\"}");
+            return;
+        }
+
+        if (!form.has("tag")) {
+            send(res, HTTPResponse::HTTP_BAD_REQUEST, "{\"error\": \"missing tag\"}");
+            return;
+        }
+
+        string tag = form.get("tag");
+        int64_t now = chrono::duration_cast<chrono::milliseconds>(
+                chrono::system_clock::now().time_since_epoch()).count();
+        int64_t start, end, step = 0;
+        try {
+            end = param(form, "end", now + 1);
+            start = param(form, "start", end - store.getRetentionMs());
+            if (path == "/aggregate") {
+                step = param(form, "step", store.getBucketMs());
+                // Reported as the store aggregates it
+                if (step <= 0) step = store.getBucketMs();
+            }
+        } catch (Poco::SyntaxException &ex) {
+            send(res, HTTPResponse::HTTP_BAD_REQUEST, "{\"error\": \"invalid number\"}");
+            return;
+        }
+
+        if (path == "/range") {
+            // Written by hand: ranges can be large and are already in columnar form
+            vector<int64_t> timestamps;
+            vector<double> values;
+            store.range(tag, start, end, timestamps, values);
+
+            ostringstream body;
+            body << setprecision(17) << "{\"tag\": " << json(tag).dump() << ", \"datapoints\": [";
+            for (size_t i = 0, n = timestamps.size(); i < n; i++) {
+                if (i) body << ", ";
+                body << '[' << timestamps[i] << ", " << values[i] << ']';
+            }
+            body << "]}";
+            send(res, HTTPResponse::HTTP_OK, body.str());
+        } else {
+            json buckets = json::array();
+            for (auto &agg : store.aggregate(tag, start, end, step)) {
+                buckets.push_back({{"start", agg.start},
+                                   {"min",   agg.min},
+                                   {"max",   agg.max},
+                                   {"avg",   agg.sum / agg.count},
+                                   {"count", agg.count}});
+            }
+            json body = {{"tag",     tag},
+                         {"step",    step},
+                         {"buckets", buckets}};
+            send(res, HTTPResponse::HTTP_OK, body.dump());
+        }
+    }
+};
+
+class QueryHandlerFactory : public HTTPRequestHandlerFactory {
+
+    HistoryStore &store;
+
+public:
+
+    QueryHandlerFactory(HistoryStore &store) : store(store) {}
+
+    HTTPRequestHandler *createRequestHandler(const HTTPServerRequest &) override {
+        return new QueryHandler(store);
+    }
+};
+
+}
+
+HistoryServer::~HistoryServer() {
+    stop();
+}
+
+void HistoryServer::start() {
+    if (!store.isEnabled() || server)
+        return;
+
+    auto host = cfg.getString("history.bind", "127.0.0.1");
+    auto port = (Poco::UInt16) cfg.getInt("history.port", 8080);
+    HTTPServerParams::Ptr params = new HTTPServerParams;
+    params->setMaxThreads(cfg.getInt("history.threads", 2));
+    try {
+        server.reset(new HTTPServer(new QueryHandlerFactory(store),
+                                    ServerSocket(SocketAddress(host, port)), params));
+    } catch (Poco::Exception &ex) {
+        // The history is optional: keep ingesting without the endpoint
+        logger.error("Cannot listen on %s:%d, history queries disabled. Cause: %s", host, (int) port,
+                     ex.displayText());
+        return;
+    }
+    server->start();
+    logger.information("Serving local history queries on %s:%d", host, (int) port);
+}
+
+void HistoryServer::stop() {
+    if (server) {
+        server->stop();
+        server.reset();
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef PREDIX_HISTORYSERVER_H
+#define PREDIX_HISTORYSERVER_H
+
+#include "Application.h"
+#include "HistoryStore.h"
+#include <Poco/Net/HTTPServer.h>
+#include <memory>
+
+/**
+ * Local HTTP endpoint serving queries on the HistoryStore (and the process metrics).
+ *
+ *   GET /tags                                          JSON array of tag names
+ *   GET /range?tag=T[&start=ms][&end=ms]               raw points of a tag
+ *   GET /aggregate?tag=T[&start=ms][&end=ms][&step=ms] min/max/avg/count per step
+ *   GET /metrics                                       all metrics as a JSON object
+ *
+ * 'start' and 'end' default to the whole retention. Listens on "history.bind" (default
+ * 127.0.0.1, local clients only) and "history.port" (default 8080) when the history store
+ * is enabled. If the address can't be bound the error is logged and the emulator runs
+ * without the endpoint.
+ */
+class HistoryServer {
+
+    Configuration &cfg;
+
+    HistoryStore &store;
+
+    std::unique_ptr<Poco::Net::HTTPServer> server;
+
+    Poco::Logger &logger;
+
+public:
+
+    HistoryServer(Configuration &cfg, HistoryStore &store) :
+            cfg(cfg), store(store), logger(Poco::Logger::get("HistoryServer")) {};
+
+    ~HistoryServer();
+
+    // Starts serving in background threads. Does nothing if the store is disabled.
+    void start();
+
+    void stop();
+};
+
+
+#endif //PREDIX_HISTORYSERVER_H
@@ -0,0 +1,123 @@
+#include "HistoryStore.h"
+#include <algorithm>
+#include <map>
+
+using namespace std;
+
+HistoryStore::HistoryStore(Configuration &cfg) {
+    enabled = cfg.getBool("history.enabled", false);
+    bucketMs = max(1, cfg.getInt("history.bucket_ms", 1000));
+    int64_t retention = (int64_t) (cfg.getDouble("history.minutes", 10) * 60000);
+    bucketCount = (size_t) max((int64_t) 1, retention / bucketMs);
+}
+
+void HistoryStore::record(const std::string &tag, int64_t timestamp, double value) {
+    if (!enabled)
+        return;
+
+    int64_t start = timestamp - timestamp % bucketMs;
+    unique_lock<mutex> lock(storeMutex);
+    auto &ring = series[tag];
+    if (ring.empty())
+        ring.resize(bucketCount);
+
+    auto &bucket = ring[(size_t) (start / bucketMs) % bucketCount];
+    if (bucket.start != start) {
+        // Late point for a bucket that was already recycled
+        if (start < bucket.start)
+            return;
+        bucket.start = start;
+        bucket.offsets.clear();
+        bucket.values.clear();
+    }
+
+    if (bucket.values.empty()) {
+        bucket.min = bucket.max = bucket.sum = value;
+    } else {
+        bucket.min = min(bucket.min, value);
+        bucket.max = max(bucket.max, value);
+        bucket.sum += value;
+    }
+    bucket.offsets.push_back((uint32_t) (timestamp - start));
+    bucket.values.push_back(value);
+}
+
+std::vector<std::string> HistoryStore::tags() {
+    unique_lock<mutex> lock(storeMutex);
+    vector<string> result;
+    for (auto &item : series) result.push_back(item.first);
+    sort(result.begin(), result.end());
+    return result;
+}
+
+template<typename F>
+void HistoryStore::forEachBucket(const std::string &tag, int64_t start, int64_t end, F fn) {
+    auto it = series.find(tag);
+    if (it == series.end() || end <= start)
+        return;
+
+    auto &ring = it->second;
+    int64_t first = start - start % bucketMs;
+    // no need to look further back than the retention
+    first = max(first, end - end % bucketMs - (int64_t) (bucketCount - 1) * bucketMs);
+    for (int64_t b = first; b < end; b += bucketMs) {
+        auto &bucket = ring[(size_t) (b / bucketMs) % bucketCount];
+        if (bucket.start == b && !bucket.values.empty())
+            fn(bucket);
+    }
+}
+
+void HistoryStore::range(const std::string &tag, int64_t start, int64_t end,
+                         std::vector<int64_t> &timestamps, std::vector<double> &values) {
+    unique_lock<mutex> lock(storeMutex);
+    forEachBucket(tag, start, end, [&](const Bucket &bucket) {
+        for (size_t i = 0, n = bucket.values.size(); i < n; i++) {
+            int64_t ts = bucket.start + bucket.offsets[i];
+            if (ts >= start && ts < end) {
+                timestamps.push_back(ts);
+                values.push_back(bucket.values[i]);
+            }
+        }
+    });
+}
+
+std::vector<HistoryStore::Aggregate> HistoryStore::aggregate(const std::string &tag, int64_t start,
+                                                             int64_t end, int64_t stepMs) {
+    if (stepMs <= 0)
+        stepMs = bucketMs;
+
+    map<int64_t, Aggregate> steps;
+    auto add = [&](int64_t ts, double min, double max, double sum, int64_t count) {
+        int64_t stepStart = ts - ts % stepMs;
+        auto it = steps.find(stepStart);
+        if (it == steps.end()) {
+            steps[stepStart] = {stepStart, min, max, sum, count};
+        } else {
+            auto &agg = it->second;
+            agg.min = std::min(agg.min, min);
+            agg.max = std::max(agg.max, max);
+            agg.sum += sum;
+            agg.count += count;
+        }
+    };
+
+    unique_lock<mutex> lock(storeMutex);
+    bool aligned = stepMs % bucketMs == 0;
+    forEachBucket(tag, start, end, [&](const Bucket &bucket) {
+        if (aligned && bucket.start >= start && bucket.start + bucketMs <= end) {
+            // The bucket summary is enough
+            add(bucket.start, bucket.min, bucket.max, bucket.sum, (int64_t) bucket.values.size());
+            return;
+        }
+        for (size_t i = 0, n = bucket.values.size(); i < n; i++) {
+            int64_t ts = bucket.start + bucket.offsets[i];
+            if (ts >= start && ts < end)
+                add(ts, bucket.values[i], bucket.values[i], bucket.values[i], 1);
+        }
+    });
+
+    vector<Aggregate> result;
+    result.reserve(steps.size());
+    for (auto &item : steps) result.push_back(item.second);
+    return result;
+}
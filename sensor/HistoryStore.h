@@ -0,0 +1,89 @@
+#ifndef PREDIX_HISTORYSTORE_H
+#define PREDIX_HISTORYSTORE_H
+
+#include "Application.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+
+/**
+ * In-process store of the recent timeseries history, so local dashboards can query it
+ * without a round trip to the Predix query API.
+ *
+ * Each tag keeps a ring of fixed-width time buckets ("history.bucket_ms") covering the last
+ * "history.minutes". A bucket stores its points in columnar form (millisecond offsets and
+ * values) plus running min/max/sum, so aggregates aligned to the bucket width are answered
+ * without touching the points.
+ *
+ * Disabled unless "history.enabled" is true. This class is thread-safe.
+ */
+class HistoryStore {
+public:
+
+    struct Aggregate {
+        int64_t start;
+        double min;
+        double max;
+        double sum;
+        int64_t count;
+    };
+
+private:
+
+    struct Bucket {
+        // Bucket start time, -1 if never used
+        int64_t start = -1;
+        std::vector<uint32_t> offsets;
+        std::vector<double> values;
+        double min = 0;
+        double max = 0;
+        double sum = 0;
+    };
+
+    bool enabled;
+
+    int64_t bucketMs;
+
+    size_t bucketCount;
+
+    std::unordered_map<std::string, std::vector<Bucket>> series;
+
+    std::mutex storeMutex;
+
+    // Calls 'fn' for each live bucket of 'tag' overlapping [start, end). Lock must be held.
+    template<typename F>
+    void forEachBucket(const std::string &tag, int64_t start, int64_t end, F fn);
+
+public:
+
+    HistoryStore(Configuration &cfg);
+
+    bool isEnabled() const { return enabled; }
+
+    int64_t getBucketMs() const { return bucketMs; }
+
+    // Retention, in milliseconds
+    int64_t getRetentionMs() const { return bucketMs * (int64_t) bucketCount; }
+
+    void record(const std::string &tag, int64_t timestamp, double value);
+
+    std::vector<std::string> tags();
+
+    /**
+     * Raw points of 'tag' with timestamps in [start, end), in bucket order.
+     */
+    void range(const std::string &tag, int64_t start, int64_t end,
+               std::vector<int64_t> &timestamps, std::vector<double> &values);
+
+    /**
+     * Aggregates of 'tag' over [start, end) in 'stepMs' wide steps. Empty steps are
+     * omitted.
+     */
+    std::vector<Aggregate> aggregate(const std::string &tag, int64_t start, int64_t end,
+                                     int64_t stepMs);
+};
+
+
+#endif //PREDIX_HISTORYSTORE_H
@@ -0,0 +1,216 @@
+#include "JsonSax.h"
+#include "errors.h"
+#include <Poco/Logger.h>
+#include <cstdlib>
+
+#define PARSE_CHUNK_SIZE 65536
+
+using namespace std;
+
+void JsonSaxParser::fail(const char *reason) {
+    Poco::Logger::get("JsonSaxParser").error("JSON syntax error: %s", string(reason));
+    throw ERR_GENERIC_EXCEPTION;
+}
+
+static void appendUtf8(string &out, unsigned cp) {
+    if (cp < 0x80) {
+        out.push_back((char) cp);
+    } else if (cp < 0x800) {
+        out.push_back((char) (0xc0 | (cp >> 6)));
+        out.push_back((char) (0x80 | (cp & 0x3f)));
+    } else if (cp < 0x10000) {
+        out.push_back((char) (0xe0 | (cp >> 12)));
+        out.push_back((char) (0x80 | ((cp >> 6) & 0x3f)));
+        out.push_back((char) (0x80 | (cp & 0x3f)));
+    } else {
+        out.push_back((char) (0xf0 | (cp >> 18)));
+        out.push_back((char) (0x80 | ((cp >> 12) & 0x3f)));
+        out.push_back((char) (0x80 | ((cp >> 6) & 0x3f)));
+        out.push_back((char) (0x80 | (cp & 0x3f)));
+    }
+}
+
+// Replaces unpaired surrogates, which have no UTF-8 encoding
+#define REPLACEMENT_CHARACTER 0xfffd
+
+void JsonSaxParser::unicodeEscape(unsigned unit) {
+    if (unit >= 0xdc00 && unit <= 0xdfff && highSurrogate) {
+        appendUtf8(token, 0x10000 + ((highSurrogate - 0xd800) << 10) + (unit - 0xdc00));
+        highSurrogate = 0;
+        return;
+    }
+    dropHighSurrogate();
+    if (unit >= 0xd800 && unit <= 0xdbff) {
+        highSurrogate = unit;
+    } else if (unit >= 0xdc00 && unit <= 0xdfff) {
+        appendUtf8(token, REPLACEMENT_CHARACTER);
+    } else {
+        appendUtf8(token, unit);
+    }
+}
+
+void JsonSaxParser::dropHighSurrogate() {
+    if (highSurrogate) {
+        appendUtf8(token, REPLACEMENT_CHARACTER);
+        highSurrogate = 0;
+    }
+}
+
+// Emits the pending number or literal token
+void JsonSaxParser::endToken() {
+    if (state == NUMBER) {
+        char *end;
+        double value = strtod(token.c_str(), &end);
+        if (*end != '\0')
+            fail("invalid number");
+        handler.numberValue(value, token);
+    } else if (state == LITERAL) {
+        if (token == "true") {
+            handler.boolValue(true);
+        } else if (token == "false") {
+            handler.boolValue(false);
+        } else if (token == "null") {
+            handler.nullValue();
+        } else {
+            fail("invalid literal");
+        }
+    }
+    token.clear();
+    state = VALUE;
+}
+
+void JsonSaxParser::structural(char c) {
+    switch (c) {
+        case '{':
+            handler.startObject();
+            containers.push_back('{');
+            expectKey = true;
+            break;
+        case '[':
+            handler.startArray();
+            containers.push_back('[');
+            expectKey = false;
+            break;
+        case '}':
+        case ']':
+            if (containers.empty() || containers.back() != (c == '}' ? '{' : '['))
+                fail("unbalanced brackets");
+            containers.pop_back();
+            if (c == '}') handler.endObject(); else handler.endArray();
+            expectKey = false;
+            break;
+        case ',':
+            expectKey = !containers.empty() && containers.back() == '{';
+            break;
+        case ':':
+            expectKey = false;
+            break;
+        case '"':
+            state = STRING;
+            stringIsKey = expectKey;
+            break;
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+            break;
+        default:
+            if (c == '-' || (c >= '0' && c <= '9')) {
+                state = NUMBER;
+                token.push_back(c);
+            } else if (c >= 'a' && c <= 'z') {
+                state = LITERAL;
+                token.push_back(c);
+            } else {
+                fail("unexpected character");
+            }
+    }
+}
+
+void JsonSaxParser::feed(const char *data, size_t size) {
+    for (const char *p = data, *end = data + size; p < end; p++) {
+        char c = *p;
+        switch (state) {
+            case VALUE:
+                structural(c);
+                break;
+
+            case STRING:
+                if (c != '\\')
+                    dropHighSurrogate();
+                if (c == '"') {
+                    if (stringIsKey) handler.key(token); else handler.stringValue(token);
+                    token.clear();
+                    state = VALUE;
+                } else if (c == '\\') {
+                    state = STRING_ESCAPE;
+                } else {
+                    token.push_back(c);
+                }
+                break;
+
+            case STRING_ESCAPE:
+                state = STRING;
+                if (c != 'u')
+                    dropHighSurrogate();
+                switch (c) {
+                    case 'n': token.push_back('\n'); break;
+                    case 't': token.push_back('\t'); break;
+                    case 'r': token.push_back('\r'); break;
+                    case 'b': token.push_back('\b'); break;
+                    case 'f': token.push_back('\f'); break;
+                    case 'u':
+                        state = STRING_UNICODE;
+                        unicode = 0;
+                        unicodeDigits = 0;
+                        break;
+                    default: token.push_back(c);
+                }
+                break;
+
+            case STRING_UNICODE: {
+                int digit = c >= '0' && c <= '9' ? c - '0' :
+                            c >= 'a' && c <= 'f' ? c - 'a' + 10 :
+                            c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+                if (digit < 0)
+                    fail("invalid unicode escape");
+                unicode = unicode * 16 + digit;
+                if (++unicodeDigits == 4) {
+                    unicodeEscape(unicode);
+                    state = STRING;
+                }
+                break;
+            }
+
+            case NUMBER:
+            case LITERAL:
+                if ((state == NUMBER && ((c >= '0' && c <= '9') || c == '.' || c == 'e' ||
+                                         c == 'E' || c == '+' || c == '-')) ||
+                    (state == LITERAL && c >= 'a' && c <= 'z')) {
+                    token.push_back(c);
+                } else {
+                    endToken();
+                    structural(c);
+                }
+                break;
+        }
+    }
+}
+
+void JsonSaxParser::finish() {
+    if (state == NUMBER || state == LITERAL)
+        endToken();
+    if (state != VALUE || !containers.empty())
+        fail("unexpected end of document");
+}
+
+void JsonSaxParser::parse(std::istream &in) {
+    vector<char> buf(PARSE_CHUNK_SIZE);
+    while (in) {
+        in.read(buf.data(), buf.size());
+        auto n = in.gcount();
+        if (n > 0)
+            feed(buf.data(), (size_t) n);
+    }
+    finish();
+}
@@ -0,0 +1,106 @@
+#ifndef PREDIX_JSONSAX_H
+#define PREDIX_JSONSAX_H
+
+#include <string>
+#include <vector>
+#include <istream>
+
+/**
+ * Callbacks of the streaming JSON parser. Override the events of interest.
+ */
+class JsonSaxHandler {
+public:
+    virtual ~JsonSaxHandler() {}
+
+    virtual void startObject() {}
+
+    virtual void endObject() {}
+
+    virtual void startArray() {}
+
+    virtual void endArray() {}
+
+    // An object member name. The value events follow.
+    virtual void key(const std::string &) {}
+
+    virtual void stringValue(const std::string &) {}
+
+    // 'raw' is the number as it appears in the document
+    virtual void numberValue(double, const std::string &) {}
+
+    virtual void boolValue(bool) {}
+
+    virtual void nullValue() {}
+};
+
+/**
+ * Incremental (SAX style) JSON parser.
+ *
+ * The document may be fed in chunks of any size: tokens split across chunks are buffered.
+ * Memory use is bounded by the largest token and the nesting depth, not the document size,
+ * which makes it suitable for large query responses.
+ *
+ * Syntax errors throw ERR_GENERIC_EXCEPTION. The parser checks the token syntax and the
+ * bracket nesting, not the full JSON grammar.
+ */
+class JsonSaxParser {
+
+    enum State {
+        VALUE,
+        STRING,
+        STRING_ESCAPE,
+        STRING_UNICODE,
+        NUMBER,
+        LITERAL
+    };
+
+    JsonSaxHandler &handler;
+
+    State state = VALUE;
+
+    // Open containers, '{' or '['
+    std::vector<char> containers;
+
+    // Whether the next string in the current object is a member name
+    bool expectKey = false;
+    bool stringIsKey = false;
+
+    // Token being accumulated
+    std::string token;
+    unsigned unicode = 0;
+    int unicodeDigits = 0;
+
+    // High half of a surrogate pair (\uD800-\uDBFF) waiting for the low half, 0 if none
+    unsigned highSurrogate = 0;
+
+    void fail(const char *reason);
+
+    void endToken();
+
+    // Appends a \u escape to the string token, combining surrogate pairs
+    void unicodeEscape(unsigned unit);
+
+    // Ends a surrogate pair missing its low half
+    void dropHighSurrogate();
+
+    void structural(char c);
+
+public:
+
+    JsonSaxParser(JsonSaxHandler &handler) : handler(handler) {};
+
+    void feed(const char *data, size_t size);
+
+    /**
+     * Ends the document, flushing a trailing top-level number or literal.
+     */
+    void finish();
+
+    /**
+     * Feeds the whole stream and finishes the document.
+     */
+    void parse(std::istream &in);
+};
+
+
+#endif //PREDIX_JSONSAX_H
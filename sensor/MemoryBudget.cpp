@@ -0,0 +1,65 @@
+#include "MemoryBudget.h"
+#include "Metrics.h"
+#include "errors.h"
+#include <chrono>
+
+using namespace std;
+
+MemoryBudget::MemoryBudget(Configuration &cfg) :
+        usedMetric(Metrics::instance().get(Metrics::zoned(cfg, "memory.used_bytes"))),
+        blockedMsMetric(Metrics::instance().get(Metrics::zoned(cfg, "memory.blocked_ms"))) {
+
+    limit = (size_t) (cfg.getDouble("memory.budget_mb", 0) * 1024 * 1024);
+
+    string name = cfg.getString("memory.policy", "block");
+    if (name == "block") {
+        policy = BLOCK;
+    } else if (name == "drop_oldest") {
+        policy = DROP_OLDEST;
+    } else if (name == "drop_newest") {
+        policy = DROP_NEWEST;
+    } else if (name == "decimate") {
+        policy = DECIMATE;
+    } else {
+        Poco::Logger::get("MemoryBudget").error("Invalid memory.policy: %s", name);
+        throw ERR_GENERIC_EXCEPTION;
+    }
+
+    Metrics::instance().get(Metrics::zoned(cfg, "memory.budget_bytes")) = (int64_t) limit;
+}
+
+bool MemoryBudget::reserve(size_t bytes, bool wait) {
+    unique_lock<mutex> lock(budgetMutex);
+    if (limit && used + bytes > limit) {
+        // a message larger than the whole budget would wait forever
+        if (!wait || bytes > limit || shuttingDown)
+            return false;
+
+        auto start = chrono::steady_clock::now();
+        released.wait(lock, [&]() { return used + bytes <= limit || shuttingDown; });
+        blockedMsMetric += chrono::duration_cast<chrono::milliseconds>(
+                chrono::steady_clock::now() - start).count();
+        if (used + bytes > limit)
+            return false;
+    }
+    used += bytes;
+    usedMetric = (int64_t) used;
+    return true;
+}
+
+void MemoryBudget::shutdown() {
+    {
+        unique_lock<mutex> lock(budgetMutex);
+        shuttingDown = true;
+    }
+    released.notify_all();
+}
+
+void MemoryBudget::release(size_t bytes) {
+    {
+        unique_lock<mutex> lock(budgetMutex);
+        used = bytes > used ? 0 : used - bytes;
+        usedMetric = (int64_t) used;
+    }
+    released.notify_all();
+}
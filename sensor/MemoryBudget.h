@@ -0,0 +1,78 @@
+#ifndef PREDIX_MEMORYBUDGET_H
+#define PREDIX_MEMORYBUDGET_H
+
+#include "Application.h"
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+/**
+ * Accounts the memory held by all queued messages against a configured byte budget.
+ *
+ * Configured by "memory.budget_mb" (0, the default, means unlimited) and "memory.policy",
+ * the action the Sender takes when an enqueue does not fit:
+ *
+ *   block        Wait until the sender frees enough memory (backpressure to the producer).
+ *   drop_oldest  Evict the oldest unsent messages.
+ *   drop_newest  Discard the incoming message.
+ *   decimate     Evict every other unsent message of the incoming tag, halving its
+ *                resolution.
+ *
+ * This class is thread-safe.
+ */
+class MemoryBudget {
+public:
+    enum Policy {
+        BLOCK,
+        DROP_OLDEST,
+        DROP_NEWEST,
+        DECIMATE
+    };
+
+private:
+    size_t limit = 0;
+
+    size_t used = 0;
+
+    Policy policy = BLOCK;
+
+    // Set by 'shutdown': reserve no longer waits
+    bool shuttingDown = false;
+
+    std::mutex budgetMutex;
+
+    std::condition_variable released;
+
+    // Exported metrics
+    std::atomic<int64_t> &usedMetric;
+    std::atomic<int64_t> &blockedMsMetric;
+
+public:
+
+    MemoryBudget(Configuration &cfg);
+
+    Policy getPolicy() const { return policy; }
+
+    size_t getLimit() const { return limit; }
+
+    /**
+     * Tries to account 'bytes' in the budget. With 'wait', blocks until the memory is
+     * available (only returns false when a single message exceeds the whole budget, or on
+     * shutdown). Without it, returns false immediately when over budget.
+     */
+    bool reserve(size_t bytes, bool wait);
+
+    /**
+     * Wakes up the blocked producers, which get false from 'reserve'. Later calls that don't
+     * fit don't wait either. Used to stop the producers.
+     */
+    void shutdown();
+
+    /**
+     * Returns 'bytes' to the budget and wakes up blocked producers.
+     */
+    void release(size_t bytes);
+};
+
+
+#endif //PREDIX_MEMORYBUDGET_H
@@ -18,13 +18,36 @@ struct TimeSeriesMessage {
     int64_t transactionId = TRANSACTION_NEW;
 };
 
-// Message for the asset service
+// Message for the asset service. It summarizes 'count' alarm samples taken from
+// 'firstTimestamp' to 'timestamp'; 'value' is the last one.
 struct AssetMessage {
     std::string sensor_id;
     int64_t timestamp;
     double value;
     std::string message;
+    int64_t firstTimestamp;
+    int64_t count = 1;
+    double minValue;
+    double maxValue;
     int64_t transactionId = TRANSACTION_NEW;
 };
 
+// Approximate memory held by a queued message, used for memory budget accounting.
+inline size_t footprint(const TimeSeriesMessage &msg) {
+    return sizeof(TimeSeriesMessage) + msg.tagname.capacity();
+}
+
+inline size_t footprint(const AssetMessage &msg) {
+    return sizeof(AssetMessage) + msg.sensor_id.capacity() + msg.message.capacity();
+}
+
+// The sensor/tag a message belongs to
+inline const std::string &messageKey(const TimeSeriesMessage &msg) {
+    return msg.tagname;
+}
+
+inline const std::string &messageKey(const AssetMessage &msg) {
+    return msg.sensor_id;
+}
+
 #endif //PREDIX_MESSAGES_H
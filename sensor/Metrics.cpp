@@ -0,0 +1,41 @@
+#include "Metrics.h"
+#include <sstream>
+
+using namespace std;
+
+Metrics &Metrics::instance() {
+    static Metrics metrics;
+    return metrics;
+}
+
+std::atomic<int64_t> &Metrics::get(const std::string &name) {
+    unique_lock<mutex> lock(metricsMutex);
+    auto &value = values[name];
+    if (!value) {
+        value.reset(new atomic<int64_t>(0));
+    }
+    return *value;
+}
+
+std::vector<std::pair<std::string, int64_t>> Metrics::snapshot() {
+    unique_lock<mutex> lock(metricsMutex);
+    vector<pair<string, int64_t>> result;
+    result.reserve(values.size());
+    for (auto &item : values) {
+        result.emplace_back(item.first, item.second->load());
+    }
+    return result;
+}
+
+std::string Metrics::zoned(const Poco::Util::AbstractConfiguration &cfg, const std::string &name) {
+    auto zone = cfg.getString("sender.zone", "");
+    return zone.empty() ? name : "zone." + zone + "." + name;
+}
+
+void Metrics::report(Poco::Logger &logger) {
+    ostringstream line;
+    for (auto &item : snapshot()) {
+        line << ' ' << item.first << '=' << item.second;
+    }
+    logger.information("Metrics:" + line.str());
+}
@@ -0,0 +1,58 @@
+#ifndef PREDIX_METRICS_H
+#define PREDIX_METRICS_H
+
+#include <string>
+#include <map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <Poco/Logger.h>
+#include <Poco/Util/AbstractConfiguration.h>
+
+/**
+ * Process-wide registry of named integer metrics (counters and gauges).
+ *
+ * Lookup takes a lock, so hot paths should fetch the metric reference once and keep it:
+ * references returned by 'get' stay valid for the life of the process.
+ *
+ * Metrics of the components owned by a zone (queues, batching, egress, retries...) are named
+ * after it, see 'zoned'. The others are process totals.
+ */
+class Metrics {
+
+    std::mutex metricsMutex;
+
+    std::map<std::string, std::unique_ptr<std::atomic<int64_t>>> values;
+
+    Metrics() {};
+
+public:
+
+    static Metrics &instance();
+
+    /**
+     * Returns the metric with the given name, creating it (with value 0) on first use.
+     */
+    std::atomic<int64_t> &get(const std::string &name);
+
+    /**
+     * Returns the current value of every metric, sorted by name.
+     */
+    std::vector<std::pair<std::string, int64_t>> snapshot();
+
+    /**
+     * Returns the name of metric 'name' in the zone configured by 'cfg' ("sender.zone"):
+     * "zone.<zone>.<name>", or 'name' as is outside zones.
+     */
+    static std::string zoned(const Poco::Util::AbstractConfiguration &cfg, const std::string &name);
+
+    /**
+     * Logs all metrics as a single information line.
+     */
+    void report(Poco::Logger &logger);
+};
+
+
+#endif //PREDIX_METRICS_H
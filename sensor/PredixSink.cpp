@@ -0,0 +1,152 @@
+#include "PredixSink.h"
+#include "HTTPClient.h"
+#include "errors.h"
+#include "Metrics.h"
+#include "StartupTimeline.h"
+#include "Tracing.h"
+#include <nlohmann/json.hpp>
+#include <Poco/UUIDGenerator.h>
+#include <unordered_map>
+
+#define REQUEST_TIMEOUT_MS 10000
+
+// Silence before the WebSocket is pinged
+#define PING_INTERVAL_MS 250
+
+// Time the WebSocket has to answer a ping before it's considered dead
+#define PONG_TIMEOUT_MS 750
+
+using namespace std;
+using namespace nlohmann;
+
+PredixTimeseriesSink::PredixTimeseriesSink(Configuration &cfg) :
+        cfg(cfg),
+        ws(make_shared<WSClient>(cfg.getString("timeseries.ingest_uri"), Metrics::zoned(cfg, "ws"))),
+        logger(Poco::Logger::get("PredixTimeseriesSink")) {
+}
+
+void PredixTimeseriesSink::prewarm() {
+    TRACE_SPAN(span, "ts.prewarm");
+    ws->prewarm();
+}
+
+void PredixTimeseriesSink::open(const std::string &token) {
+    TRACE_SPAN(span, "ts.connect");
+
+    logger.information("Connecting to the TS WebSocket");
+    string zone_id = cfg.getString("timeseries.zone_id");
+    string client_id = cfg.getString("sensor.client_id");
+
+    // set appropriate headers. The client is kept to resume its TLS session.
+    ws->setHeader("Authorization", "Bearer " + token);
+    ws->setHeader("Predix-Zone-Id", zone_id);
+    ws->setHeader("Origin", "sensor://" + client_id);
+    ws->connect();
+    ws->setSendTimeout(REQUEST_TIMEOUT_MS);
+    ws->setRecvTimeout(REQUEST_TIMEOUT_MS);
+    ws->setPingInterval(cfg.getInt("timeseries.ping_interval_ms", PING_INTERVAL_MS));
+    ws->setPongTimeout(cfg.getInt("timeseries.pong_timeout_ms", PONG_TIMEOUT_MS));
+    StartupTimeline::instance().mark("ws_upgrade");
+    logger.information("Connected!");
+}
+
+size_t PredixTimeseriesSink::send(const std::vector<TimeSeriesMessage> &batch, int64_t batchId) {
+    // First we group the data by tagname assuming we're getting more than one class of data
+    TRACE_SPAN(span, "ts.group");
+    unordered_map<string, vector<const TimeSeriesMessage *>> data;
+    for (auto &msg : batch) {
+        data[msg.tagname].push_back(&msg);
+    }
+
+    // Prepare message body
+    span.next("ts.json");
+    json body = json::array();
+    for (auto &item : data) {
+        auto tagname = item.first;
+        auto msglist = item.second;
+        json datapoints = json::array();
+        for (size_t i = 0, n = msglist.size(); i < n; i++) {
+            auto msg = msglist[i];
+            datapoints.push_back({msg->timestamp, msg->value, 3});
+        }
+        body.push_back({{"name",       tagname},
+                        {"datapoints", datapoints}});
+    }
+
+    // Prepare payload message
+    string messageId = "msg-" + to_string(batchId);
+    json payload = {{"messageId", messageId},
+                    {"body",      body}};
+
+    // Send message and receive confirmation
+    auto sendtxt = payload.dump();
+    span.next("ts.sendText");
+    ws->sendText(sendtxt);
+    span.next("ts.ack");
+    auto recvtxt = ws->receiveText();
+    auto recv = json::parse(recvtxt);
+    int code = recv["statusCode"];
+    if (code == 401 || code == 403) {
+        throw ERR_INVALID_TOKEN;
+    } else if (code >= 400 && code <= 499) {
+        logger.error("Timeseries ingestion rejected %s with status %d", messageId, code);
+        throw ERR_INVALID_REQUEST;
+    } else if (code >= 500 && code <= 599) {
+        throw ERR_SERVER_ERROR;
+    } else if (code < 200 || code > 299) {
+        logger.error("Unknown timeseries ack status: %d", code);
+        throw ERR_GENERIC_EXCEPTION;
+    }
+
+    // The ack of another batch: the stream is out of step, reconnect and resend
+    if (recv["messageId"] != messageId) {
+        logger.warning("Expected the ack of %s, got %s", messageId, recv["messageId"].dump());
+        throw ERR_CONNECTION_LOST;
+    }
+    return sendtxt.size();
+}
+
+void PredixTimeseriesSink::keepalive() {
+    ws->keepalive();
+}
+
+size_t PredixAssetSink::send(const std::vector<AssetMessage> &batch, int64_t batchId) {
+    auto base_uri = cfg.getString("asset.uri");
+    auto zone_id = cfg.getString("asset.zone_id");
+    auto collection = cfg.getString("asset.collection");
+    auto post_uri = base_uri + collection;
+
+    // Create an object for each message
+    TRACE_SPAN(span, "asset.json");
+    json body = json::array();
+    for (auto &msg: batch) {
+        auto uuid = Poco::UUIDGenerator::defaultGenerator().createRandom().toString();
+        string uri = collection + '/' + uuid;
+        json value = {
+                {"uri",       uri},
+                {"sensor_id", msg.sensor_id},
+                {"timestamp", msg.timestamp},
+                {"val",       msg.value},
+                {"msg",       msg.message},
+                {"first_timestamp", msg.firstTimestamp},
+                {"count",     msg.count},
+                {"min",       msg.minValue},
+                {"max",       msg.maxValue},
+        };
+        body.push_back(value);
+    }
+
+    // create the POST request
+    auto client = HTTPClient(post_uri);
+    client.setHeader("Authorization", "Bearer " + token);
+    client.setHeader("Predix-Zone-Id", zone_id);
+    auto bodytxt = body.dump();
+    client.setBody(bodytxt);
+    client.setTimeout(REQUEST_TIMEOUT_MS);
+    client.setContentType(HTTPClient::CT_JSON);
+    span.next("asset.post");
+    auto r = client.post();
+
+    HTTPClient::validateResponse(r);
+    return bodytxt.size();
+}
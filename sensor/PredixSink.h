@@ -0,0 +1,60 @@
+#ifndef PREDIX_PREDIXSINK_H
+#define PREDIX_PREDIXSINK_H
+
+#include "Sink.h"
+#include "WSClient.h"
+
+/**
+ * Sends timeseries batches through the Predix Timeseries ingestion WebSocket, waiting for
+ * the acknowledgement of each one.
+ */
+class PredixTimeseriesSink : public TimeseriesSink {
+
+    Configuration &cfg;
+
+    // Smart pointer to the Websocket client
+    std::shared_ptr<WSClient> ws;
+
+    Poco::Logger &logger;
+
+public:
+
+    PredixTimeseriesSink(Configuration &cfg);
+
+    bool needsToken() const override { return true; }
+
+    void prewarm() override;
+
+    /**
+     * Opens the Websocket connection to the timeseries service
+     */
+    void open(const std::string &token) override;
+
+    size_t send(const std::vector<TimeSeriesMessage> &batch, int64_t batchId) override;
+
+    void keepalive() override;
+};
+
+/**
+ * Creates an Asset service object for each message, one POST request per batch.
+ */
+class PredixAssetSink : public AssetSink {
+
+    Configuration &cfg;
+
+    // The access_token given to open
+    std::string token;
+
+public:
+
+    PredixAssetSink(Configuration &cfg) : cfg(cfg) {}
+
+    bool needsToken() const override { return true; }
+
+    void open(const std::string &token) override { this->token = token; }
+
+    size_t send(const std::vector<AssetMessage> &batch, int64_t batchId) override;
+};
+
+
+#endif //PREDIX_PREDIXSINK_H
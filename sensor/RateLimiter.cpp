@@ -0,0 +1,112 @@
+#include "RateLimiter.h"
+#include "Metrics.h"
+#include <algorithm>
+
+// Weight of the newest sample in the live rate average
+#define LIVE_RATE_ALPHA 0.2
+
+using namespace std;
+using namespace std::chrono;
+
+// The bucket must hold at least one token, or rates under one per burst never allow anything
+static double capacityOf(double rate, double burstSeconds) {
+    return max(1.0, rate * burstSeconds);
+}
+
+TokenBucket::TokenBucket(double rate, double burstSeconds, TimePoint now) :
+        rate(rate), capacity(capacityOf(rate, burstSeconds)), tokens(capacity), last(now) {
+}
+
+void TokenBucket::setRate(double rate, double burstSeconds, TimePoint now) {
+    bool wasUnlimited = unlimited();
+    refill(now);
+    this->rate = rate;
+    this->capacity = capacityOf(rate, burstSeconds);
+    // a newly limited bucket starts full
+    tokens = wasUnlimited ? capacity : min(tokens, capacity);
+}
+
+void TokenBucket::refill(TimePoint now) {
+    double elapsed = duration_cast<microseconds>(now - last).count() / 1e6;
+    last = now;
+    tokens = min(capacity, tokens + elapsed * rate);
+}
+
+double TokenBucket::available(TimePoint now) {
+    if (unlimited())
+        return 1e18;
+    refill(now);
+    return tokens;
+}
+
+void TokenBucket::consume(double n, TimePoint now) {
+    if (unlimited())
+        return;
+    refill(now);
+    tokens -= n;
+}
+
+EgressLimiter::EgressLimiter(Configuration &cfg, const std::string &service) :
+        lastObserved(steady_clock::now()),
+        throttledMetric(Metrics::instance().get(Metrics::zoned(cfg, "egress." + service + ".throttled"))),
+        liveRateMetric(Metrics::instance().get(Metrics::zoned(cfg, "egress." + service + ".live_rate"))),
+        backlogMetric(Metrics::instance().get(Metrics::zoned(cfg, "egress." + service + ".backlog"))) {
+
+    double burst = cfg.getDouble("egress.burst_sec", 1);
+    points.setRate(cfg.getDouble("egress." + service + ".points_per_sec", 0), burst);
+    bytes.setRate(cfg.getDouble("egress." + service + ".bytes_per_sec", 0), burst);
+    catchupMultiple = service == "timeseries" ? cfg.getDouble("egress.catchup_multiple", 0) : 0;
+    liveWindowMs = cfg.getInt("egress.live_window_ms", 2000);
+
+    // Until the live rate is known the backlog drains slowly
+    if (catchupEnabled())
+        catchup.setRate(1);
+}
+
+size_t EgressLimiter::allowance(size_t wanted) {
+    // Bytes are only known after the payload is built: wait while in debt.
+    if (bytes.available() < 0) {
+        throttledMetric++;
+        return 0;
+    }
+    double tokens = points.available();
+    if (tokens < 1 && wanted > 0) {
+        throttledMetric++;
+        return 0;
+    }
+    return (size_t) min((double) wanted, tokens);
+}
+
+size_t EgressLimiter::backlogAllowance(size_t wanted) {
+    if (!catchupEnabled())
+        return wanted;
+    double tokens = catchup.available();
+    return tokens < 1 ? 0 : (size_t) min((double) wanted, tokens);
+}
+
+void EgressLimiter::observeProduced(int64_t produced, size_t backlog) {
+    backlogMetric = (int64_t) backlog;
+
+    auto now = steady_clock::now();
+    double elapsed = duration_cast<microseconds>(now - lastObserved).count() / 1e6;
+    if (elapsed < 0.1)
+        return;
+
+    double rate = (produced - lastProduced) / elapsed;
+    liveRate = liveRate == 0 ? rate : LIVE_RATE_ALPHA * rate + (1 - LIVE_RATE_ALPHA) * liveRate;
+    lastProduced = produced;
+    lastObserved = now;
+    liveRateMetric = (int64_t) liveRate;
+
+    if (catchupEnabled()) {
+        // at least one point per second so the backlog always drains
+        catchup.setRate(max(1.0, liveRate * catchupMultiple));
+    }
+}
+
+void EgressLimiter::onSent(size_t points, size_t backlogPoints, size_t bytes) {
+    this->points.consume(points);
+    this->bytes.consume(bytes);
+    if (catchupEnabled())
+        catchup.consume(backlogPoints);
+}
@@ -0,0 +1,111 @@
+#ifndef PREDIX_RATELIMITER_H
+#define PREDIX_RATELIMITER_H
+
+#include "Application.h"
+#include <chrono>
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+/**
+ * Classic token bucket. A rate of 0 means unlimited. The bucket holds at least one token, so
+ * rates under one token per burst still let one through every 1/rate seconds.
+ *
+ * Consuming more tokens than available is allowed and leaves the bucket in debt, so a
+ * large message is sent at once and the following ones wait for the debt to be paid.
+ *
+ * Every call takes the current time, the steady clock by default, so tests can drive it.
+ */
+class TokenBucket {
+public:
+
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+private:
+
+    double rate;
+    double capacity;
+    double tokens;
+    TimePoint last;
+
+    void refill(TimePoint now);
+
+public:
+
+    TokenBucket(double rate = 0, double burstSeconds = 1,
+                TimePoint now = std::chrono::steady_clock::now());
+
+    bool unlimited() const { return rate <= 0; }
+
+    // Changes the rate, keeping the current tokens.
+    void setRate(double rate, double burstSeconds = 1,
+                 TimePoint now = std::chrono::steady_clock::now());
+
+    // Currently available tokens. May be negative when in debt.
+    double available(TimePoint now = std::chrono::steady_clock::now());
+
+    void consume(double n, TimePoint now = std::chrono::steady_clock::now());
+};
+
+/**
+ * Egress limits of one service ("timeseries" or "asset"), configured by
+ * "egress.<service>.points_per_sec" and "egress.<service>.bytes_per_sec".
+ *
+ * For the timeseries service, when "egress.catchup_multiple" is set, points older than
+ * "egress.live_window_ms" are considered backlog (eg. accumulated during an outage) and are
+ * drained at that multiple of the measured live production rate, while live points keep
+ * being sent first.
+ *
+ * Only used from the sender thread.
+ */
+class EgressLimiter {
+
+    TokenBucket points;
+    TokenBucket bytes;
+    TokenBucket catchup;
+
+    double catchupMultiple;
+    int64_t liveWindowMs;
+
+    // Live production rate (points/s), exponentially smoothed
+    double liveRate = 0;
+    int64_t lastProduced = 0;
+    std::chrono::steady_clock::time_point lastObserved;
+
+    // Exported metrics
+    std::atomic<int64_t> &throttledMetric;
+    std::atomic<int64_t> &liveRateMetric;
+    std::atomic<int64_t> &backlogMetric;
+
+public:
+
+    EgressLimiter(Configuration &cfg, const std::string &service);
+
+    /**
+     * How many points may be sent now, out of 'wanted'. Zero when throttled.
+     */
+    size_t allowance(size_t wanted);
+
+    bool catchupEnabled() const { return catchupMultiple > 0; }
+
+    // Points with timestamps older than this are backlog
+    int64_t liveCutoff(int64_t now) const { return now - liveWindowMs; }
+
+    /**
+     * How many backlog points may be sent now, out of 'wanted'.
+     */
+    size_t backlogAllowance(size_t wanted);
+
+    /**
+     * Updates the live production rate from a monotonic count of produced points.
+     */
+    void observeProduced(int64_t produced, size_t backlog);
+
+    /**
+     * Accounts a sent batch.
+     */
+    void onSent(size_t points, size_t backlogPoints, size_t bytes);
+};
+
+
+#endif //PREDIX_RATELIMITER_H
@@ -0,0 +1,105 @@
+#include "Replayer.h"
+#include "Capture.h"
+#include "errors.h"
+#include <Poco/SharedMemory.h>
+#include <Poco/File.h>
+#include <Poco/NumberParser.h>
+#include <thread>
+#include <vector>
+#include <chrono>
+
+// Maximum points enqueued at once
+#define REPLAY_BATCH_SIZE 1024
+
+using namespace std;
+using namespace std::chrono;
+
+void Replayer::run() {
+    // get configuration parameters
+    string path = cfg.getString("replay.file");
+    string speedStr = cfg.getString("replay.speed", "1");
+    bool rebase = cfg.getBool("replay.rebase_timestamps", false);
+    bool maxSpeed = speedStr == "max";
+    double speed = maxSpeed ? 0 : Poco::NumberParser::parseFloat(speedStr);
+    if (!maxSpeed && speed <= 0) {
+        logger.error("Invalid replay.speed: %s", speedStr);
+        throw ERR_GENERIC_EXCEPTION;
+    }
+
+    Poco::File file(path);
+    if (!file.exists() || file.getSize() == 0) {
+        logger.error("Cannot replay missing or empty capture file: %s", path);
+        throw ERR_GENERIC_EXCEPTION;
+    }
+
+    // Map the whole capture. Reading is then just decoding from the page cache.
+    Poco::SharedMemory mapping(file, Poco::SharedMemory::AM_READ);
+    capture::Reader reader(mapping.begin(), (size_t) (mapping.end() - mapping.begin()));
+
+    logger.information("Replaying %s at %s speed.", path, maxSpeed ? string("max") : speedStr + "x");
+
+    capture::Record rec;
+    int64_t count = 0;
+    int64_t firstTimestamp = 0;
+    int64_t pacedTimestamp = 0;
+    int64_t offset = 0;
+    auto start = steady_clock::now();
+
+    // Points are enqueued in batches, flushed before waiting for the clock
+    vector<TimeSeriesMessage> tsBatch;
+    vector<AssetMessage> assetBatch;
+    auto flush = [&]() {
+        sender.queueTimeseriesMessages(tsBatch);
+        sender.queueAssetMessages(assetBatch);
+    };
+
+    while (reader.next(rec)) {
+        if (count == 0) {
+            firstTimestamp = pacedTimestamp = rec.timestamp;
+            if (rebase) {
+                offset = duration_cast<milliseconds>(
+                        system_clock::now().time_since_epoch()).count() - firstTimestamp;
+            }
+        }
+
+        // Only look at the clock when the stream moved forward, so bursts of points with the
+        // same timestamp are fed without any syscall.
+        if (!maxSpeed && rec.timestamp > pacedTimestamp) {
+            pacedTimestamp = rec.timestamp;
+            auto due = start + microseconds((int64_t) ((rec.timestamp - firstTimestamp) * 1000 / speed));
+            if (due > steady_clock::now()) {
+                flush();
+                this_thread::sleep_until(due);
+            }
+        }
+
+        int64_t timestamp = rec.timestamp + offset;
+        if (rec.type == capture::OP_TS) {
+            tsBatch.emplace_back();
+            auto &msg = tsBatch.back();
+            msg.tagname = *rec.tag;
+            msg.timestamp = timestamp;
+            msg.value = rec.value;
+        } else {
+            assetBatch.emplace_back();
+            auto &msg = assetBatch.back();
+            msg.sensor_id = *rec.tag;
+            msg.timestamp = timestamp;
+            msg.value = rec.value;
+            msg.message = *rec.message;
+            msg.firstTimestamp = rec.firstTimestamp + offset;
+            msg.count = rec.count;
+            msg.minValue = rec.minValue;
+            msg.maxValue = rec.maxValue;
+        }
+        if (tsBatch.size() + assetBatch.size() >= REPLAY_BATCH_SIZE)
+            flush();
+        count++;
+    }
+    flush();
+
+    auto elapsed = duration_cast<milliseconds>(steady_clock::now() - start).count();
+    logger.information("Replay finished: %d records in %d ms (%.0f records/s).",
+                       (int) count, (int) elapsed,
+                       elapsed ? count * 1000.0 / elapsed : (double) count);
+}
@@ -0,0 +1,33 @@
+#ifndef PREDIX_REPLAYER_H
+#define PREDIX_REPLAYER_H
+
+#include "Application.h"
+#include "Sender.h"
+
+/**
+ * Feeds a capture file (see Capture.h) into the Sender queues instead of sampling fresh
+ * data. Used to reproduce a recorded stream exactly.
+ *
+ * The capture is memory-mapped and replayed in the recorded order, either at the original
+ * pace, N times faster or as fast as possible ("replay.speed" = 1, N or "max").
+ */
+class Replayer {
+
+    // Instance of the application configuration
+    Configuration &cfg;
+
+    // Sender object
+    Sender &sender;
+
+    Poco::Logger &logger;
+
+public:
+    Replayer(Configuration &cfg, Sender &sender) :
+            cfg(cfg), sender(sender),
+            logger(Poco::Logger::get("Replayer")) {};
+
+    void run();
+};
+
+
+#endif //PREDIX_REPLAYER_H
@@ -0,0 +1,68 @@
+#include "RetryPolicy.h"
+#include "Metrics.h"
+#include "errors.h"
+#include <algorithm>
+
+using namespace std;
+
+RetryPolicy::RetryPolicy(Configuration &cfg, const std::string &service) :
+        service(service), failures(0), serverErrors(0), random(random_device()()),
+        failuresMetric(Metrics::instance().get(Metrics::zoned(cfg, "retry." + service + ".failures"))),
+        breakerOpensMetric(Metrics::instance().get(Metrics::zoned(cfg, "retry." + service + ".breaker_opens"))),
+        recoveriesMetric(Metrics::instance().get(Metrics::zoned(cfg, "retry." + service + ".recoveries"))),
+        lastRecoveryMetric(Metrics::instance().get(Metrics::zoned(cfg, "retry." + service + ".last_recovery_ms"))),
+        maxRecoveryMetric(Metrics::instance().get(Metrics::zoned(cfg, "retry." + service + ".max_recovery_ms"))),
+        totalRecoveryMetric(Metrics::instance().get(Metrics::zoned(cfg, "retry." + service + ".total_recovery_ms"))) {
+
+    baseMs = max((int64_t) 1, (int64_t) cfg.getInt("retry.base_ms", 500));
+    maxMs = max(baseMs, (int64_t) cfg.getInt("retry.max_ms", 30000));
+    breakerFailures = cfg.getInt("retry.breaker_failures", 5);
+    breakerOpenMs = cfg.getInt("retry.breaker_open_ms", 60000);
+}
+
+int64_t RetryPolicy::jitter(int64_t ms) {
+    return uniform_int_distribution<int64_t>(0, ms)(random);
+}
+
+int64_t RetryPolicy::onError(int err) {
+    if (failures == 0)
+        outageStart = chrono::steady_clock::now();
+    failures++;
+    failuresMetric++;
+
+    if (err == ERR_SERVER_ERROR) {
+        serverErrors++;
+        if (breakerOpen()) {
+            if (serverErrors == breakerFailures) {
+                breakerOpensMetric++;
+                Poco::Logger::get("RetryPolicy").warning(
+                        "%d consecutive %s server errors, backing off for %ld ms",
+                        serverErrors, service, (long) breakerOpenMs);
+            }
+            // between half and the whole open period
+            return breakerOpenMs / 2 + jitter(breakerOpenMs / 2);
+        }
+    } else {
+        serverErrors = 0;
+        if (failures == 1)
+            return 0;
+    }
+
+    // base * 2^(failures - 1), capped
+    int shift = min(failures - 1, 30);
+    return jitter(min(maxMs, baseMs << shift));
+}
+
+void RetryPolicy::recovered() {
+    auto ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - outageStart).count();
+    Poco::Logger::get("RetryPolicy").information("%s recovered after %d failures in %ld ms",
+                                                 service, failures, (long) ms);
+
+    recoveriesMetric++;
+    lastRecoveryMetric = ms;
+    totalRecoveryMetric += ms;
+    if (ms > maxRecoveryMetric) maxRecoveryMetric = ms;
+
+    failures = 0;
+    serverErrors = 0;
+}
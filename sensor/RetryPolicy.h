@@ -0,0 +1,89 @@
+#ifndef PREDIX_RETRYPOLICY_H
+#define PREDIX_RETRYPOLICY_H
+
+#include "Application.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <string>
+
+/**
+ * Decides how long the sender waits before reconnecting to a service ("timeseries" or
+ * "asset") after a recoverable error. Each service has its own policy.
+ *
+ * A first transient failure (connection lost or refused, timeout, rejected token) is retried
+ * right away: the cached access_token is reused, so a blip only costs a reconnect. Further
+ * consecutive failures back off exponentially from "retry.base_ms" up to "retry.max_ms",
+ * with full jitter (a uniform delay between 0 and the backoff) so a fleet of emulators
+ * doesn't reconnect in lockstep after a server restart.
+ *
+ * Server errors (5xx) are never retried right away. After "retry.breaker_failures"
+ * consecutive ones the circuit opens: the service is left alone for about
+ * "retry.breaker_open_ms" (jittered) before a single trial, which reopens it on failure.
+ *
+ * An outage ends on the first acknowledged batch; its duration is exported in the
+ * "retry.<service>.*" metrics.
+ *
+ * Only used from the sender thread.
+ */
+class RetryPolicy {
+
+    std::string service;
+
+    int64_t baseMs;
+    int64_t maxMs;
+    int breakerFailures;
+    int64_t breakerOpenMs;
+
+    // Consecutive failures, and consecutive server errors among them
+    int failures;
+    int serverErrors;
+
+    // Start of the current outage, when failures > 0
+    std::chrono::steady_clock::time_point outageStart;
+
+    std::mt19937 random;
+
+    // Exported metrics
+    std::atomic<int64_t> &failuresMetric;
+    std::atomic<int64_t> &breakerOpensMetric;
+    std::atomic<int64_t> &recoveriesMetric;
+    std::atomic<int64_t> &lastRecoveryMetric;
+    std::atomic<int64_t> &maxRecoveryMetric;
+    std::atomic<int64_t> &totalRecoveryMetric;
+
+    // Uniform delay in [0, ms]
+    int64_t jitter(int64_t ms);
+
+public:
+
+    RetryPolicy(Configuration &cfg, const std::string &service);
+
+    /**
+     * Feeds back a recoverable error.
+     *
+     * @return the milliseconds to wait before reconnecting.
+     */
+    int64_t onError(int err);
+
+    /**
+     * Feeds back an acknowledged batch. Ends the current outage, if any.
+     */
+    void onSuccess() {
+        if (failures > 0) recovered();
+    }
+
+    // Consecutive failures so far
+    int failureCount() const { return failures; }
+
+    // Whether the circuit breaker is open
+    bool breakerOpen() const { return breakerFailures > 0 && serverErrors >= breakerFailures; }
+
+private:
+
+    void recovered();
+};
+
+
+#endif //PREDIX_RETRYPOLICY_H
@@ -3,10 +3,14 @@
 //
 
 #include "Sampler.h"
+#include "AsyncLog.h"
+#include "StartupTimeline.h"
+#include "AlertCoalescer.h"
 #include <string>
 #include <random>
 #include <thread>
 #include <iostream>
+#include <vector>
 
 using namespace std;
 
@@ -23,30 +27,65 @@ void Sampler::run() {
     int64_t dt = (int64_t) (cfg.getDouble("sensor.dt") * 1000.0);
     string deviceUUID = cfg.getString("sensor.client_id");
 
+    // Simulated sensors [first, first + count). A fleet of a single sensor is named after the
+    // device. "sensor.total" is the fleet size when this process only simulates a shard of it.
+    int first = cfg.getInt("sensor.first", 0);
+    int count = cfg.getInt("sensor.count", 1);
+    int total = cfg.getInt("sensor.total", count);
+    vector<string> sensorIds;
+    for (int i = first; i < first + count; i++) {
+        sensorIds.push_back(first == 0 && total == 1 ? deviceUUID : deviceUUID + "-" + to_string(i));
+    }
+
+    // Per-sample debug messages are rate limited so debug level can stay enabled
+    int debugRate = cfg.getInt("logging.sample_debug_rate", 100);
+
     // Get a pseudo-RNG to simulate data sampling
     std::mt19937 gen;
     std::uniform_real_distribution<double> dist(0.0, 1.0);
 
-    string assetContent{"ERROR: Sensor overloaded"};
+    // Overload samples are reported to the asset service, one record per burst
+    AlertCoalescer alerts(cfg, sensorIds.size(), "ERROR: Sensor overloaded");
+
+    // Messages are buffered until the sender is connected
+    StartupTimeline::instance().mark("sampling");
+
+    // Messages of a tick, enqueued at once. Reused to keep their capacity.
+    vector<TimeSeriesMessage> tsBatch;
+    vector<AssetMessage> assetBatch;
+    tsBatch.reserve(sensorIds.size());
 
     // Main loop. Sends messages to asset or time-series services according to challenge rule.
-    for (;;) {
-        double rnd = dist(gen);
+    while (running) {
         int64_t timestamp = get_current_time_ms();
-        if (rnd < p + m) {
-            poco_debug_f1(logger, "TS: %.5f", rnd);
-            sender.queueTimeseriesMessage(deviceUUID, timestamp, rnd);
-        }
-        if (rnd < m) {
-            poco_debug_f1(logger, "Asset: %.5f", rnd);
-            sender.queueAssetMessage(deviceUUID, timestamp, rnd, assetContent);
-        }
+        for (size_t i = 0; i < sensorIds.size(); i++) {
+            auto &sensorId = sensorIds[i];
+            double rnd = dist(gen);
+            if (rnd < p + m) {
+                async_debug_rate(logger, debugRate, "TS: %.5f", rnd);
+                tsBatch.emplace_back();
+                auto &msg = tsBatch.back();
+                msg.tagname = sensorId;
+                msg.timestamp = timestamp;
+                msg.value = rnd;
+            }
+            if (rnd < m) {
+                async_debug_rate(logger, debugRate, "Asset: %.5f", rnd);
+            }
+            alerts.sample(i, sensorId, timestamp, rnd, rnd < m, assetBatch);
 
-        if (rnd >= p + m) {
-            poco_debug_f1(logger, "NOOP: %.5f", rnd);
+            if (rnd >= p + m) {
+                async_debug_rate(logger, debugRate, "NOOP: %.5f", rnd);
+            }
         }
+        sender.queueTimeseriesMessages(tsBatch);
+        sender.queueAssetMessages(assetBatch);
 
         std::this_thread::sleep_for(std::chrono::milliseconds(dt));
     }
+
+    // Report the bursts still open
+    alerts.flush(sensorIds, assetBatch);
+    sender.queueAssetMessages(assetBatch);
 }
 
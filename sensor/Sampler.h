@@ -7,6 +7,7 @@
 
 #include "Application.h"
 #include "Sender.h"
+#include <atomic>
 
 /**
  * "Sampler" class that simulates the sampling of sensor data.
@@ -21,13 +22,25 @@ class Sampler {
 
     Poco::Logger &logger;
 
+    // Cleared by 'stop'
+    std::atomic<bool> running;
 
 public:
     Sampler(Configuration &cfg, Sender &sender) :
             cfg(cfg), sender(sender),
-            logger(Poco::Logger::get("Sampler")) {};
+            logger(Poco::Logger::get("Sampler")), running(true) {};
 
+    /**
+     * Samples until 'stop' is called, then enqueues the pending alerts.
+     */
     void run();
+
+    // Makes 'run' return after the current tick, even if blocked on the Sender's memory
+    // budget. Thread-safe.
+    void stop() {
+        running = false;
+        sender.stopWaiting();
+    }
 };
 
 
@@ -3,259 +3,400 @@
 //
 
 #include "Sender.h"
-#include <nlohmann/json.hpp>
 #include "errors.h"
-#include "HTTPClient.h"
-#include <Poco/UUIDGenerator.h>
+#include "AsyncLog.h"
+#include "UAAClient.h"
+#include "StartupTimeline.h"
+#include "Tracing.h"
+#include <future>
+#include <cstdint>
 
 #define REQUEST_TIMEOUT_MS 10000
-#define DISPATCH_SLEEP_TIME_MS 100
-#define ERROR_SLEEP_MS 5000
 
-using namespace std;
-using namespace nlohmann;
+// How often rounds check on a reconnection in progress
+#define CONNECT_POLL_MS 20
 
-void Sender::run() {
+// Tokens are refreshed this long before UAA says they expire
+#define TOKEN_EXPIRY_MARGIN_S 60
 
-    for (;;) {
-        try {
-            // Outer loop to handle re-connection
-            login();
-            connect();
+// Validity assumed when UAA doesn't report it
+#define TOKEN_DEFAULT_VALIDITY_S 3600
+
+using namespace std;
 
-            for (;;) {
-                // Send messages in queues
-                sendTimeseries();
-                sendAsset();
+// Queue metrics are reported per zone, see Zone
+Sender::Sender(Configuration &cfg, HistoryStore &history) :
+        cfg(cfg), tsSink(makeTimeseriesSink(cfg)), assetSink(makeAssetSink(cfg)),
+        tsService(cfg, "timeseries"), assetService(cfg, "asset"),
+        history(history), budget(cfg), batchController(cfg),
+        tsEgress(cfg, "timeseries"), assetEgress(cfg, "asset"),
+        tsEnqueuedMetric(Metrics::instance().get(Metrics::zoned(cfg, "queue.ts.enqueued"))),
+        tsLengthMetric(Metrics::instance().get(Metrics::zoned(cfg, "queue.ts.length"))),
+        tsDroppedMetric(Metrics::instance().get(Metrics::zoned(cfg, "queue.ts.dropped"))),
+        assetLengthMetric(Metrics::instance().get(Metrics::zoned(cfg, "queue.asset.length"))),
+        assetDroppedMetric(Metrics::instance().get(Metrics::zoned(cfg, "queue.asset.dropped"))),
+        logger(Poco::Logger::get(cfg.has("sender.zone") ? "Sender." + cfg.getString("sender.zone") : "Sender")) {
+    if (cfg.has("capture.file")) {
+        auto path = cfg.getString("capture.file");
+        captureWriter.reset(new capture::Writer(path));
+        logger.information("Capturing sent messages to %s", path);
+    }
+}
+
+Sender::~Sender() {
+    {
+        unique_lock<mutex> lock(connectMutex);
+        stopping = true;
+    }
+    connectChanged.notify_all();
+    if (connector.joinable())
+        connector.join();
+}
 
-                // Sleep for a while to avoid busy-wait
-                this_thread::sleep_for(chrono::milliseconds(DISPATCH_SLEEP_TIME_MS));
+int64_t Sender::step(size_t &budget) {
+    // Reconnect after an error on the connect thread: an unreachable service must not hold
+    // a pool thread for a whole request timeout, nor the other service.
+    bool done;
+    {
+        unique_lock<mutex> lock(connectMutex);
+        done = connectDone;
+        if (done)
+            connectRequested = connectDone = false;
+    }
+    if (done) {
+        for (auto service : {&tsService, &assetService}) {
+            if (!service->connecting)
+                continue;
+            service->connecting = false;
+            if (service->connectError) {
+                onError(*service, service->connectError);
+                service->connectError = 0;
+            } else {
+                service->connected = true;
+            }
+        }
+    }
+    {
+        unique_lock<mutex> lock(connectMutex);
+        if (!connectRequested) {
+            auto now = chrono::steady_clock::now();
+            tsService.connecting = !tsService.connected && now >= tsService.retryAt;
+            assetService.connecting = !assetService.connected && now >= assetService.retryAt;
+            if (tsService.connecting || assetService.connecting) {
+                connectRequested = true;
+                if (!connector.joinable())
+                    connector = thread(&Sender::connectLoop, this);
+                connectChanged.notify_all();
             }
+        }
+    }
+
+    // Send messages in queues
+    if (tsService.connected) {
+        try {
+            sendTimeseries(budget);
+            tsSink->flush();
+            tsSink->keepalive();
         } catch (int err) {
+            onError(tsService, err);
+        }
+    }
 
-            // rollback any pending message sending transaction
-            rollbackTransaction();
+    if (assetService.connected) {
+        try {
+            sendAsset();
+            assetSink->flush();
+            assetSink->keepalive();
+        } catch (int err) {
+            onError(assetService, err);
+        }
+    }
+
+    if (captureWriter) captureWriter->flush();
 
-            // handle known errors appropriately
-            handleError(err);
+    // Linger for a while to avoid busy-wait and let the next batch fill, unless there's
+    // more to send than the budget allowed. Wake up for a pending reconnection.
+    auto now = chrono::steady_clock::now();
+    auto next = chrono::steady_clock::time_point::max();
+    if (tsService.connected || assetService.connected) {
+        next = now + chrono::milliseconds(budget == 0 && tsService.connected ? 0 : batchController.lingerMs());
+    }
+    for (auto service : {&tsService, &assetService}) {
+        if (service->connecting) {
+            next = min(next, now + chrono::milliseconds(CONNECT_POLL_MS));
+        } else if (!service->connected) {
+            next = min(next, service->retryAt);
         }
     }
+    return max((int64_t) 0, (int64_t) chrono::duration_cast<chrono::milliseconds>(next - now).count());
+}
+
+void Sender::onError(Service &service, int err) {
+    service.connected = false;
 
+    // rollback any pending message sending transaction
+    logger.information("Rolling back %s transaction.", service.name);
+    if (&service == &tsService) {
+        batchController.onError();
+        rollbackTransaction(tsQueue, tsQueueMutex);
+    } else {
+        rollbackTransaction(assetQueue, assetQueueMutex);
+    }
 
+    // handle known errors appropriately
+    service.retryAt = chrono::steady_clock::now() + chrono::milliseconds(handleError(service, err));
 }
 
 void Sender::queueTimeseriesMessage(std::string tagname, int64_t timestamp, double value) {
-    std::unique_lock<mutex> lock(tsQueueMutex);
+    tsEnqueuedMetric++;
     TimeSeriesMessage msg;
-    msg.tagname = tagname;
+    msg.tagname = move(tagname);
     msg.timestamp = timestamp;
     msg.value = value;
-    tsQueue.push_back(msg);
+    enqueue(tsQueue, tsQueueMutex, &msg, &msg + 1, tsLengthMetric, tsDroppedMetric);
 }
 
 void Sender::queueAssetMessage(std::string sensorId, int64_t timestamp, double value,
                                std::string message) {
-    std::unique_lock<mutex> lock(assetQueueMutex);
     AssetMessage msg;
-    msg.sensor_id = sensorId;
+    msg.sensor_id = move(sensorId);
     msg.timestamp = timestamp;
     msg.value = value;
-    msg.message = message;
-    assetQueue.push_back(msg);
+    msg.message = move(message);
+    msg.firstTimestamp = timestamp;
+    msg.minValue = msg.maxValue = value;
+    enqueue(assetQueue, assetQueueMutex, &msg, &msg + 1, assetLengthMetric, assetDroppedMetric);
 }
 
-void Sender::connect() {
-
-    logger.information("Connecting to the TS WebSocket");
-    string ts_uri = cfg.getString("timeseries.ingest_uri");
-    string zone_id = cfg.getString("timeseries.zone_id");
-    string client_id = cfg.getString("sensor.client_id");
-
-    // set appropriate headers
-    ws = make_shared<WSClient>(ts_uri);
-    ws->setHeader("Authorization", "Bearer " + token);
-    ws->setHeader("Predix-Zone-Id", zone_id);
-    ws->setHeader("Origin", "sensor://" + client_id);
-    ws->connect();
-    ws->setSendTimeout(REQUEST_TIMEOUT_MS);
-    ws->setRecvTimeout(REQUEST_TIMEOUT_MS);
-    logger.information("Connected!");
+void Sender::queueTimeseriesMessages(std::vector<TimeSeriesMessage> &messages) {
+    if (messages.empty())
+        return;
+    tsEnqueuedMetric += (int64_t) messages.size();
+    enqueue(tsQueue, tsQueueMutex, messages.data(), messages.data() + messages.size(),
+            tsLengthMetric, tsDroppedMetric);
+    messages.clear();
 }
 
+void Sender::queueAssetMessages(std::vector<AssetMessage> &messages) {
+    if (messages.empty())
+        return;
+    enqueue(assetQueue, assetQueueMutex, messages.data(), messages.data() + messages.size(),
+            assetLengthMetric, assetDroppedMetric);
+    messages.clear();
+}
 
-void Sender::sendTimeseries() {
-    // No need to lock for now, we're not messing with the queue structure.
+void Sender::sendTimeseries(size_t &budget) {
+    TRACE_SPAN(span, "ts.select");
+    transactionId++;
 
-    if (tsQueue.size() == 0)
-        return;
+    size_t limit = tsEgress.allowance(min(budget, batchController.batchSize()));
+    int64_t cutoff = tsEgress.liveCutoff(chrono::duration_cast<chrono::milliseconds>(
+            chrono::system_clock::now().time_since_epoch()).count());
 
-    logger.debug("Sending %d messages to the TIMESERIES service.", (int) tsQueue.size());
+    // Copy the messages to send while holding the lock. The producer may append or evict
+    // messages while we're sending, so nothing below may point into the queue.
+    vector<TimeSeriesMessage> batch;
+    size_t backlogCount = 0;
+    {
+        std::unique_lock<mutex> lock(tsQueueMutex);
+        auto select = [&](TimeSeriesMessage &msg) {
+            if (msg.transactionId == TRANSACTION_NEW) {
+                msg.transactionId = transactionId;
+                batch.push_back(msg);
+            }
+        };
+
+        if (tsEgress.catchupEnabled()) {
+            // The queue is only mostly in timestamp order (replays, clock steps, evictions), so
+            // each message is classified instead of searching for where the live ones start.
+            // This costs a scan of the queue, as 'commit' does anyway.
+            auto isLive = [cutoff](const TimeSeriesMessage &msg) { return msg.timestamp >= cutoff; };
+            size_t backlog = (size_t) count_if(tsQueue.begin(), tsQueue.end(),
+                                               [&](const TimeSeriesMessage &msg) { return !isLive(msg); });
+            tsEgress.observeProduced(tsEnqueuedMetric, backlog);
+
+            // Live messages first, newest to oldest, so fresh data stays timely
+            for (auto it = tsQueue.rbegin(); it != tsQueue.rend() && batch.size() < limit; ++it) {
+                if (isLive(*it)) select(*it);
+            }
+            size_t liveCount = batch.size();
 
-    transactionId++;
-    // First we group the data by tagname assuming we're getting more than one class of data
-    unordered_map<string, vector<TimeSeriesMessage *>> data;
-    for (size_t i = 0, n = tsQueue.size(); i < n; i++) {
-        auto &msg = tsQueue[i];
-        if (msg.transactionId == TRANSACTION_NEW) {
-            msg.transactionId = transactionId;
-            data[msg.tagname].push_back(&msg);
+            // then the backlog, oldest first, at the catch-up rate
+            size_t backlogLimit = batch.size() + tsEgress.backlogAllowance(limit - batch.size());
+            for (auto it = tsQueue.begin(); it != tsQueue.end() && batch.size() < backlogLimit; ++it) {
+                if (!isLive(*it)) select(*it);
+            }
+            backlogCount = batch.size() - liveCount;
+        } else {
+            for (auto it = tsQueue.begin(); it != tsQueue.end() && batch.size() < limit; ++it) {
+                select(*it);
+            }
         }
     }
 
-    // Prepare message body
-    json body = json::array();
-    for (auto &item : data) {
-        auto tagname = item.first;
-        auto msglist = item.second;
-        json datapoints = json::array();
-        for (size_t i = 0, n = msglist.size(); i < n; i++) {
-            auto msg = msglist[i];
-            datapoints.push_back({msg->timestamp, msg->value, 3});
-        }
-        body.push_back({{"name",       tagname},
-                        {"datapoints", datapoints}});
+    if (batch.empty()) {
+        span.discard();
+        return;
     }
 
-    // Prepare payload message
-    string messageId = "msg-" + to_string(transactionId);
-    json payload = {{"messageId", messageId},
-                    {"body",      body}};
-
-    // Send message and receive confirmation
-    auto sendtxt = payload.dump();
-    ws->sendText(sendtxt);
-    auto recvtxt = ws->receiveText();
-    auto recv = json::parse(recvtxt);
-    int code = recv["statusCode"];
-    if (code >= 200 && code <= 299) {
-        assert(recv["messageId"] == messageId);
-        commit(tsQueue, tsQueueMutex, transactionId);
-    } else {
-        // An invalid status code is not expected.
-        throw ERR_GENERIC_EXCEPTION;
+    async_debug(logger, "Sending %d messages to the TIMESERIES service.", batch.size());
+
+    span.next("ts.send");
+    auto sendStart = chrono::steady_clock::now();
+    auto bytes = tsSink->send(batch, transactionId);
+    auto rtt = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - sendStart);
+    tsEgress.onSent(batch.size(), backlogCount, bytes);
+    budget -= batch.size();
+
+    span.next("ts.commit");
+    commit(tsQueue, tsQueueMutex, transactionId, tsLengthMetric);
+    batchController.onAck(batch.size(), rtt.count());
+    tsService.retry.onSuccess();
+
+    if (captureWriter) {
+        // Live points were selected newest first: restore time order for the replay pacing
+        stable_sort(batch.begin(), batch.end(), [](const TimeSeriesMessage &a, const TimeSeriesMessage &b) {
+            return a.timestamp < b.timestamp;
+        });
+        for (auto &msg : batch) captureWriter->writeTimeseries(msg.tagname, msg.timestamp, msg.value);
+    }
+
+    if (!firstAckReported) {
+        firstAckReported = true;
+        StartupTimeline::instance().mark("first_ack");
+        StartupTimeline::instance().report(logger);
     }
 }
 
 void Sender::sendAsset() {
+    TRACE_SPAN(span, "asset.select");
     transactionId++;
 
-    if (assetQueue.size() == 0)
-        return;
-
-    logger.debug("Sending %d messages to the ASSET service.", (int) assetQueue.size());
-
-    auto base_uri = cfg.getString("asset.uri");
-    auto zone_id = cfg.getString("asset.zone_id");
-    auto collection = cfg.getString("asset.collection");
-    auto post_uri = base_uri + collection;
-
-    // Create an object for each message
-    json body = json::array();
-    for (auto &msg: assetQueue) {
-        if (msg.transactionId == TRANSACTION_NEW) {
-            msg.transactionId = transactionId;
-            auto uuid = Poco::UUIDGenerator::defaultGenerator().createRandom().toString();
-            string uri = collection + '/' + uuid;
-            json value = {
-                    {"uri",       uri},
-                    {"sensor_id", msg.sensor_id},
-                    {"timestamp", msg.timestamp},
-                    {"val",       msg.value},
-                    {"msg",       msg.message},
-            };
-            body.push_back(value);
+    size_t limit = assetEgress.allowance(SIZE_MAX);
+    vector<AssetMessage> batch;
+    {
+        std::unique_lock<mutex> lock(assetQueueMutex);
+        for (auto &msg : assetQueue) {
+            if (batch.size() >= limit)
+                break;
+            if (msg.transactionId == TRANSACTION_NEW) {
+                msg.transactionId = transactionId;
+                batch.push_back(msg);
+            }
         }
     }
 
-    // create the POST request
-    auto client = HTTPClient(post_uri);
-    client.setHeader("Authorization", "Bearer " + token);
-    client.setHeader("Predix-Zone-Id", zone_id);
-    client.setBody(body.dump());
-    client.setTimeout(REQUEST_TIMEOUT_MS);
-    client.setContentType(HTTPClient::CT_JSON);
-    auto r = client.post();
+    if (batch.empty()) {
+        span.discard();
+        return;
+    }
+
+    async_debug(logger, "Sending %d messages to the ASSET service.", batch.size());
 
-    validateResponse(r);
+    span.next("asset.send");
+    auto bytes = assetSink->send(batch, transactionId);
+    assetEgress.onSent(batch.size(), 0, bytes);
 
     // synchronized code to remove sent messages
-    commit(assetQueue, assetQueueMutex, transactionId);
-
+    span.next("asset.commit");
+    commit(assetQueue, assetQueueMutex, transactionId, assetLengthMetric);
+    assetService.retry.onSuccess();
+
+    if (captureWriter) {
+        for (auto &msg : batch) {
+            if (msg.count > 1) {
+                captureWriter->writeAlert(msg.sensor_id, msg.timestamp, msg.value, msg.message,
+                                          msg.firstTimestamp, msg.count, msg.minValue, msg.maxValue);
+            } else {
+                captureWriter->writeAsset(msg.sensor_id, msg.timestamp, msg.value, msg.message);
+            }
+        }
+    }
 }
 
 void Sender::login() {
-    logger.information("Fetching OAuth access token.");
-
+    TRACE_SPAN(span, "login");
     // Fetch access_token for this client
-    string uri = cfg.getString("uaa.uri");
-    string client_id = cfg.getString("sensor.client_id");
-    string client_secret = cfg.getString("sensor.client_secret");
-    uri.append("/oauth/token");
-
-    auto client = HTTPClient(uri);
-    client.setBasicAuth(client_id, client_secret);
-    client.setTimeout(REQUEST_TIMEOUT_MS);
-    auto form = FormBody();
-    form.set("response_type", "token");
-    form.set("grant_type", "client_credentials");
-    client.setBody(form.toString());
-    client.setContentType(HTTPClient::CT_FORM);
-    auto r = client.post();
-
-    validateResponse(r);
-
-    auto data = json::parse(r.text);
-    this->token = data["access_token"];
-    logger.information("Got OAuth access token.");
+    UAAClient uaa(cfg.getString("uaa.uri"), cfg.getString("sensor.client_id"),
+                  cfg.getString("sensor.client_secret"), REQUEST_TIMEOUT_MS);
+    auto fresh = uaa.fetchToken();
+    int64_t validity = fresh.expiresIn > 0 ? fresh.expiresIn : TOKEN_DEFAULT_VALIDITY_S;
+    this->token = fresh.accessToken;
+    this->tokenExpiry = chrono::steady_clock::now() +
+                        chrono::seconds(max((int64_t) 0, validity - TOKEN_EXPIRY_MARGIN_S));
+    StartupTimeline::instance().mark("token");
 }
 
-void Sender::rollbackTransaction() {
-    logger.information("Rolling back transaction.");
-    {
-        std::unique_lock<mutex> lock(tsQueueMutex);
-        for (auto &msg : tsQueue) msg.transactionId = TRANSACTION_NEW;
-    }
-
-    {
-        std::unique_lock<mutex> lock(assetQueueMutex);
-        for (auto &msg : assetQueue) msg.transactionId = TRANSACTION_NEW;
+void Sender::bootstrap(bool ts, bool asset) {
+    bool needsToken = (ts && tsSink->needsToken()) || (asset && assetSink->needsToken());
+    if (needsToken && (token.empty() || chrono::steady_clock::now() >= tokenExpiry)) {
+        // The TLS handshakes don't depend on the token: overlap them with the login
+        auto prewarm = async(launch::async, [this, ts, asset]() {
+            if (ts) tsSink->prewarm();
+            if (asset) assetSink->prewarm();
+        });
+        try {
+            login();
+        } catch (int err) {
+            prewarm.wait();
+            throw;
+        }
+        prewarm.get();
     }
 }
 
-void Sender::validateResponse(HTTPClient::Response r) {
-    typedef HTTPClient::ErrorCode E;
-
-    auto err = r.error_code;
+void Sender::connect(bool ts, bool asset) {
+    // Both services share the access_token, fetched once
+    try {
+        bootstrap(ts, asset);
+    } catch (int err) {
+        if (ts) tsService.connectError = err;
+        if (asset) assetService.connectError = err;
+        return;
+    }
 
-    if (err == E::OK) {
-        int status = r.status_code;
+    if (ts) {
+        try {
+            tsSink->open(token);
+        } catch (int err) {
+            tsService.connectError = err;
+        }
+    }
+    if (asset) {
+        try {
+            assetSink->open(token);
+        } catch (int err) {
+            assetService.connectError = err;
+        }
+    }
+}
 
-        if (status >= 200 && status <= 299) {
+void Sender::connectLoop() {
+    tracing::setThreadName("connect");
+    unique_lock<mutex> lock(connectMutex);
+    for (;;) {
+        connectChanged.wait(lock, [this]() { return (connectRequested && !connectDone) || stopping; });
+        if (stopping)
             return;
-        } else if (status == 401 || status == 403) {
-            throw ERR_INVALID_CREDENTIALS;
-        } else if (status >= 400 && status <= 499) {
-            throw ERR_INVALID_REQUEST;
-        } else if (status >= 500 && status <= 500) {
-            throw ERR_SERVER_ERROR;
-        } else {
-            logger.error("Unknown HTTP status: %d", status);
-            throw ERR_GENERIC_EXCEPTION;
+        bool ts = tsService.connecting;
+        bool asset = assetService.connecting;
+        if (tokenRejected) {
+            token.clear();
+            tokenRejected = false;
         }
-    } else if (err == E::GENERIC_SSL_ERROR) {
-        // Some errors that are known to be unrecoverable.
-        logger.error("Unrecoverable connection error: %s", r.error_message);
-        throw ERR_GENERIC_EXCEPTION;
-    } else {
-        // Connection errors should be recoverable after a while
-        throw ERR_CONNECTION_ERROR;
+
+        lock.unlock();
+        connect(ts, asset);
+        lock.lock();
+        connectDone = true;
     }
 }
 
-void Sender::handleError(int err) {
-    auto warn_sleep = [&](string msg, int64_t sleep_time) {
-        logger.warning("%s, Sleeping for %ld ms and trying again.", msg, (long) sleep_time);
-        this_thread::sleep_for(chrono::milliseconds(sleep_time));
+int64_t Sender::handleError(Service &service, int err) {
+    auto retry = [&](string msg) {
+        int64_t delay = service.retry.onError(err);
+        logger.warning("%s Reconnecting to the %s service in %ld ms.", msg, service.name, (long) delay);
+        return delay;
     };
 
     auto fail = [this, &err](string msg) {
@@ -268,14 +409,21 @@ void Sender::handleError(int err) {
     } else if (err == ERR_INVALID_REQUEST) {
         fail("Invalid request.");
     } else if (err == ERR_REQUEST_TIMEOUT) {
-        warn_sleep("Timeout when performing request.", ERROR_SLEEP_MS);
+        return retry("Timeout when performing request.");
     } else if (err == ERR_SERVER_ERROR) {
-        warn_sleep("Server error.", ERROR_SLEEP_MS);
+        return retry("Server error.");
     } else if (err == ERR_CONNECTION_ERROR) {
-        warn_sleep("Connection error.", ERROR_SLEEP_MS);
+        return retry("Connection error.");
+    } else if (err == ERR_CONNECTION_LOST) {
+        return retry("Connection lost.");
     } else if (err == ERR_INVALID_TOKEN) {
-        warn_sleep("Server error.", 0);
-    } else {
-        fail("Unexpected error");
+        // The token belongs to the connect thread: have it log in again
+        {
+            unique_lock<mutex> lock(connectMutex);
+            tokenRejected = true;
+        }
+        return retry("Access token rejected.");
     }
-}
\ No newline at end of file
+    fail("Unexpected error");
+    return 0;
+}
@@ -7,15 +7,26 @@
 
 #include "Application.h"
 #include "Messages.h"
-#include "WSClient.h"
-#include "HTTPClient.h"
+#include "Sink.h"
+#include "Capture.h"
+#include "MemoryBudget.h"
+#include "BatchController.h"
+#include "RetryPolicy.h"
+#include "RateLimiter.h"
+#include "HistoryStore.h"
+#include "Metrics.h"
 #include <memory>
+#include <chrono>
 #include <thread>
+#include <condition_variable>
 #include <mutex>
 #include <deque>
+#include <vector>
+#include <algorithm>
 
 /**
- * Class that sends message to Predix services.
+ * Class that sends message to Predix services, or the sinks configured for each of them
+ * (see Sink.h).
  *
  * Messages are sent enqueued using the queue_* public methods and sent asynchronously
  * later.
@@ -27,9 +38,12 @@ class Sender {
     // The application configuration instance
     Configuration& cfg;
 
-    // The current access_token
+    // The current access_token, only used by the connect thread. The sinks get a copy.
     std::string token;
 
+    // When the access_token must be refreshed. Reconnections reuse it until then.
+    std::chrono::steady_clock::time_point tokenExpiry;
+
     // Queue for time series
     std::deque<TimeSeriesMessage> tsQueue;
 
@@ -45,8 +59,75 @@ class Sender {
     // Sequential transaction_id counter
     int64_t transactionId = 0;
 
-    // Smart pointer to the Websocket client
-    std::shared_ptr<WSClient> ws;
+    // Whether the startup timeline was completed by this Sender's first ack
+    bool firstAckReported = false;
+
+    // Destination of each queue
+    std::unique_ptr<TimeseriesSink> tsSink;
+    std::unique_ptr<AssetSink> assetSink;
+
+    /**
+     * Connection and retry state of one service. Each service backs off, and opens its
+     * circuit breaker, on its own: a failing asset service doesn't hold back the timeseries.
+     */
+    struct Service {
+        std::string name;
+
+        RetryPolicy retry;
+
+        // Whether the sink is open
+        bool connected = false;
+
+        // Whether the sink is being opened by the connect thread, and the error it failed with
+        bool connecting = false;
+        int connectError = 0;
+
+        // No reconnection before this time, after an error
+        std::chrono::steady_clock::time_point retryAt;
+
+        Service(Configuration &cfg, const std::string &name) : name(name), retry(cfg, name) {}
+    };
+
+    Service tsService;
+    Service assetService;
+
+    // Opens the sinks of the services marked 'connecting', off the pool threads (see step)
+    std::thread connector;
+
+    std::mutex connectMutex;
+
+    // Signaled when a reconnection is requested or done, and on destruction
+    std::condition_variable connectChanged;
+
+    // Reconnection state, guarded by 'connectMutex'. The 'connecting' services, their sinks
+    // and the token belong to the connect thread from the request until it is done.
+    bool connectRequested = false;
+    bool connectDone = false;
+    bool tokenRejected = false;
+    bool stopping = false;
+
+    // Records every acknowledged message when "capture.file" is configured
+    std::unique_ptr<capture::Writer> captureWriter;
+
+    // Local recent history of the timeseries accepted by the queue
+    HistoryStore &history;
+
+    // Accounts the memory held by both queues
+    MemoryBudget budget;
+
+    // Tunes timeseries batch size and dispatch linger time
+    BatchController batchController;
+
+    // Egress limits per service
+    EgressLimiter tsEgress;
+    EgressLimiter assetEgress;
+
+    // Exported queue metrics
+    std::atomic<int64_t> &tsEnqueuedMetric;
+    std::atomic<int64_t> &tsLengthMetric;
+    std::atomic<int64_t> &tsDroppedMetric;
+    std::atomic<int64_t> &assetLengthMetric;
+    std::atomic<int64_t> &assetDroppedMetric;
 
     Poco::Logger& logger;
 
@@ -56,14 +137,25 @@ class Sender {
     void login();
 
     /**
-     * Opens the Websocket connection to the timeseries service
+     * Gets the sinks of the given services ready to open: fetches the access_token (unless
+     * the cached one is still valid) while the sinks do their token independent setup.
      */
-    void connect();
+    void bootstrap(bool ts, bool asset);
+
+    /**
+     * Bootstraps and opens the sinks of the given services, recording the error of each one
+     * that failed in its 'connectError'. Run by the connect thread.
+     */
+    void connect(bool ts, bool asset);
+
+    // Body of the connect thread
+    void connectLoop();
 
     /**
-     * Procedure to send the queued messages to timeseries service
+     * Procedure to send the queued messages to timeseries service, at most 'budget' points.
+     * 'budget' is decremented by the points sent.
      */
-    void sendTimeseries();
+    void sendTimeseries(size_t &budget);
 
     /**
      * Procedure to send the queued messages to asset service
@@ -71,55 +163,164 @@ class Sender {
     void sendAsset();
 
     /**
-     * Rolls-back any "sent but not confirmed" message to the "NEW" state.
+     * Rolls-back any "sent but not confirmed" message of 'queue' to the "NEW" state.
      *
      * Called when any exception is thrown.
      */
-    void rollbackTransaction();
+    template <typename T>
+    void rollbackTransaction(std::deque<T> &queue, std::mutex &mutex) {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (auto &msg : queue) msg.transactionId = TRANSACTION_NEW;
+    }
 
     /**
-     * Validates the retured HTTP status codes and, if not OK, raise the appropriate error.
+     * Handles an error of 'service': rolls back its queue and schedules its reconnection.
      */
-    void validateResponse(HTTPClient::Response r);
+    void onError(Service &service, int err);
 
     /**
-     * Handles the thrown exception. May reconnect and send/resend messages after a while
-     * in case of recoverables errors, or abort the program.
+     * Handles the thrown exception. Aborts the program on unrecoverable errors, otherwise
+     * returns the milliseconds to wait before reconnecting and resending the messages.
      */
-    void handleError(int err);
+    int64_t handleError(Service &service, int err);
 
     /**
      * Routine to "commit" sent messages.
      */
     template <typename T>
-    void commit(std::deque<T> &queue, std::mutex &mutex, int64_t &transactionId) {
+    void commit(std::deque<T> &queue, std::mutex &mutex, int64_t &transactionId,
+                std::atomic<int64_t> &lengthMetric) {
         // Lock and erase commited messages
         std::unique_lock<std::mutex> lock(mutex);
+        size_t freed = 0;
         queue.erase(
                 std::remove_if(queue.begin(), queue.end(),
-                               [=](const T &msg) -> bool {
-                                   return msg.transactionId == transactionId;
+                               [&](const T &msg) -> bool {
+                                   if (msg.transactionId != transactionId)
+                                       return false;
+                                   freed += footprint(msg);
+                                   return true;
                                }), queue.end());
+        lengthMetric = (int64_t) queue.size();
+        budget.release(freed);
     }
 
-public:
+    /**
+     * Applies the memory budget policy to make room for a 'bytes' sized message with the
+     * given key. Must be called with the queue lock held.
+     *
+     * @return false if the incoming message must be dropped.
+     */
+    template <typename T>
+    bool makeRoom(std::deque<T> &queue, const std::string &key, size_t bytes,
+                  std::atomic<int64_t> &droppedMetric) {
+        auto policy = budget.getPolicy();
+        if (policy != MemoryBudget::DROP_OLDEST && policy != MemoryBudget::DECIMATE)
+            return false;
 
-    Sender(Configuration &cfg): cfg(cfg), logger(Poco::Logger::get("Sender")) {};
+        // Only unsent messages may be evicted. Oldest messages come first in the queue.
+        size_t freed = 0;
+        int64_t dropped = 0;
+        bool toggle = false;
+        queue.erase(
+                std::remove_if(queue.begin(), queue.end(),
+                               [&](const T &msg) -> bool {
+                                   if (msg.transactionId != TRANSACTION_NEW)
+                                       return false;
+                                   if (policy == MemoryBudget::DROP_OLDEST) {
+                                       if (freed >= bytes) return false;
+                                   } else {
+                                       if (messageKey(msg) != key) return false;
+                                       toggle = !toggle;
+                                       if (!toggle) return false;
+                                   }
+                                   freed += footprint(msg);
+                                   dropped++;
+                                   return true;
+                               }), queue.end());
+        droppedMetric += dropped;
+        budget.release(freed);
+        return budget.reserve(bytes, false);
+    }
 
-    ~Sender(){
+    // Records a timeseries point accepted by the queue in the local history
+    void accepted(const TimeSeriesMessage &msg) {
+        history.record(msg.tagname, msg.timestamp, msg.value);
+    }
 
+    void accepted(const AssetMessage &) {}
+
+    /**
+     * Moves the messages in [begin, end) to the queue under a single lock, applying the
+     * memory budget policy. Messages the budget drops are not recorded in the history.
+     */
+    template <typename T>
+    void enqueue(std::deque<T> &queue, std::mutex &mutex, T *begin, T *end,
+                 std::atomic<int64_t> &lengthMetric, std::atomic<int64_t> &droppedMetric) {
+        size_t bytes = 0;
+        for (T *msg = begin; msg != end; ++msg) bytes += footprint(*msg);
+
+        // Blocking for room must happen before taking the lock, so the sender can commit.
+        bool block = budget.getPolicy() == MemoryBudget::BLOCK;
+        bool reserved = budget.reserve(bytes, block);
+        if (!reserved && block && end - begin > 1) {
+            // The batch is larger than the whole budget: wait for room message by message
+            for (T *msg = begin; msg != end; ++msg) enqueue(queue, mutex, msg, msg + 1,
+                                                            lengthMetric, droppedMetric);
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        for (T *msg = begin; msg != end; ++msg) {
+            if (!reserved) {
+                auto msgBytes = footprint(*msg);
+                if (!budget.reserve(msgBytes, false) &&
+                    !makeRoom(queue, messageKey(*msg), msgBytes, droppedMetric)) {
+                    droppedMetric++;
+                    continue;
+                }
+            }
+            accepted(*msg);
+            queue.push_back(std::move(*msg));
+        }
+        lengthMetric = (int64_t) queue.size();
     }
 
+public:
+
+    Sender(Configuration &cfg, HistoryStore &history);
+
+    ~Sender();
+
     /**
-     * Start the main dispatcher loop.
+     * Runs one round of the dispatcher: (re)connects if needed, then sends the queued
+     * messages, at most 'budget' timeseries points. 'budget' is decremented by the points
+     * sent. Errors are handled here, per service: the service's batch is rolled back and its
+     * connection reopened once its retry delay elapsed.
+     *
+     * Reconnections (login, TLS and WebSocket handshakes) run on a connect thread of the
+     * Sender, as they may block for a whole request timeout against an unreachable service.
+     * Meanwhile rounds keep sending to the services still connected. Sending still blocks the
+     * caller, for at most a request timeout (10 s) per service.
      *
-     * Should run in a separate thread from the main process loop to avoid blocking.
+     * Must not be called concurrently. Rounds are scheduled by a SenderPool.
+     *
+     * @return the milliseconds to wait before the next round; 0 if the budget ran out.
+     */
+    int64_t step(size_t &budget);
+
+    /**
+     * Wakes up the producers blocked on the memory budget ("block" policy) and stops waiting
+     * for room: messages that don't fit are dropped from now on. Called when stopping.
+     *
+     * This method is thread-safe.
      */
-    void run();
+    void stopWaiting() { budget.shutdown(); }
 
     /**
      * Add an event message to be sent to the Timeseries service. The message is sent
-     * asynchronously - you can assume this method does not blocks.
+     * asynchronously - you can assume this method does not blocks, unless the memory budget
+     * is exhausted and its policy is "block".
      *
      * This method is thread-safe.
      *
@@ -131,7 +332,8 @@ public:
 
     /**
      * Add an event message to be sent to the Asset service. The message is sent
-     * asynchronously - you can assume this method does not blocks.
+     * asynchronously - you can assume this method does not blocks, unless the memory budget
+     * is exhausted and its policy is "block".
      *
      * This method is thread-safe.
      *
@@ -143,6 +345,22 @@ public:
     void queueAssetMessage(std::string sensorId, int64_t timestamp, double value,
                            std::string message);
 
+    /**
+     * Batch version of queueTimeseriesMessage: enqueues all messages under a single lock.
+     * The messages are moved and 'messages' is cleared, keeping its capacity so the caller
+     * can reuse it for the next batch.
+     *
+     * This method is thread-safe.
+     */
+    void queueTimeseriesMessages(std::vector<TimeSeriesMessage> &messages);
+
+    /**
+     * Batch version of queueAssetMessage. See queueTimeseriesMessages.
+     *
+     * This method is thread-safe.
+     */
+    void queueAssetMessages(std::vector<AssetMessage> &messages);
+
 };
 
 
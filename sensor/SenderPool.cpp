@@ -0,0 +1,65 @@
+#include "SenderPool.h"
+#include <algorithm>
+#include <cstdint>
+
+// Default upper bound of the pool size
+#define MAX_DEFAULT_THREADS 4
+
+using namespace std;
+
+SenderPool::SenderPool(Configuration &cfg, const std::vector<Sender *> &senders) {
+    for (auto sender : senders) {
+        slots.emplace_back();
+        slots.back().sender = sender;
+    }
+    int defaultThreads = min((int) slots.size(), MAX_DEFAULT_THREADS);
+    threads = max(1, min((int) slots.size(), cfg.getInt("sender.threads", defaultThreads)));
+    quantum = slots.size() > 1 ? (size_t) max(1, cfg.getInt("sender.quantum", 20000)) : SIZE_MAX;
+
+    if (slots.size() > 1) {
+        Poco::Logger::get("SenderPool").information("%d zones on %d sender threads",
+                                                    (int) slots.size(), threads);
+    }
+}
+
+void SenderPool::work() {
+    unique_lock<mutex> lock(poolMutex);
+    for (;;) {
+        // The first due and idle slot from the cursor, or when to look again
+        auto now = chrono::steady_clock::now();
+        auto wakeup = chrono::steady_clock::time_point::max();
+        Slot *slot = nullptr;
+        for (size_t n = 0; n < slots.size(); n++) {
+            size_t index = (cursor + n) % slots.size();
+            auto &candidate = slots[index];
+            if (candidate.running)
+                continue;
+            if (candidate.due <= now) {
+                slot = &candidate;
+                cursor = (index + 1) % slots.size();
+                break;
+            }
+            wakeup = min(wakeup, candidate.due);
+        }
+
+        if (!slot) {
+            if (wakeup == chrono::steady_clock::time_point::max()) {
+                roundDone.wait(lock);
+            } else {
+                roundDone.wait_until(lock, wakeup);
+            }
+            continue;
+        }
+
+        slot->running = true;
+        size_t budget = quantum;
+        lock.unlock();
+
+        int64_t delay = slot->sender->step(budget);
+
+        lock.lock();
+        slot->running = false;
+        slot->due = chrono::steady_clock::now() + chrono::milliseconds(delay);
+        roundDone.notify_all();
+    }
+}
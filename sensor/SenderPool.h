@@ -0,0 +1,67 @@
+#ifndef PREDIX_SENDERPOOL_H
+#define PREDIX_SENDERPOOL_H
+
+#include "Application.h"
+#include "Sender.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+/**
+ * Runs the dispatcher rounds (Sender::step) of several Senders, one per zone, on a shared
+ * pool of "sender.threads" threads (default: one per Sender, up to 4).
+ *
+ * Senders are served in round-robin order, and a round may send at most "sender.quantum"
+ * timeseries points (default 20000). A Sender left with more to send is due again right
+ * away, but behind the other due ones, so a busy zone gets the same share of points per turn
+ * as the others and can't starve them. This is deficit round-robin, except that batches can
+ * be cut at any point, so no deficit needs to be carried over to the next turn. A single
+ * Sender has nobody to share with, so its rounds are only bounded by the batch size.
+ *
+ * A Sender is stepped by one thread at a time. Reconnections run off the pool (see
+ * Sender::step), but a round sending to a hung service still holds its thread for up to a
+ * request timeout (10 s): with fewer threads than zones, the other zones' rounds then wait
+ * on the remaining threads. Give each zone its own thread to isolate them completely.
+ */
+class SenderPool {
+
+    struct Slot {
+        Sender *sender;
+
+        // When the next round is due
+        std::chrono::steady_clock::time_point due;
+
+        // Whether a thread is running a round
+        bool running = false;
+    };
+
+    std::vector<Slot> slots;
+
+    // Next slot in round-robin order
+    size_t cursor = 0;
+
+    int threads;
+
+    size_t quantum;
+
+    std::mutex poolMutex;
+
+    // Signaled when a round finished
+    std::condition_variable roundDone;
+
+public:
+
+    SenderPool(Configuration &cfg, const std::vector<Sender *> &senders);
+
+    // Number of threads to run 'work' on
+    int threadCount() const { return threads; }
+
+    /**
+     * Runs rounds of the due Senders forever. Call it from each pool thread.
+     */
+    void work();
+};
+
+
+#endif //PREDIX_SENDERPOOL_H
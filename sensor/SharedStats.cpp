@@ -0,0 +1,105 @@
+#include "SharedStats.h"
+#include "Metrics.h"
+#include "errors.h"
+#include <map>
+#include <new>
+#include <sstream>
+#include <chrono>
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+SharedStats::SharedStats(int workerCount) : workerCount(workerCount) {
+    bytes = sizeof(Worker) * (size_t) workerCount;
+    void *mem = nullptr;
+#ifndef _WIN32
+    mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) mem = nullptr;
+#endif
+    if (!mem) {
+        Poco::Logger::get("SharedStats").error("Cannot map the shared stats segment");
+        throw ERR_GENERIC_EXCEPTION;
+    }
+    workers = (Worker *) mem;
+    for (int i = 0; i < workerCount; i++) {
+        new(&workers[i]) Worker();
+        workers[i].restarts = 0;
+        reset(i);
+    }
+}
+
+SharedStats::~SharedStats() {
+#ifndef _WIN32
+    munmap(workers, bytes);
+#endif
+}
+
+void SharedStats::reset(int index) {
+    auto &w = workers[index];
+    w.pid = 0;
+    w.heartbeatMs = 0;
+    w.count = 0;
+    for (auto &stat : w.stats) {
+        stat.name[0] = '\0';
+        stat.value = 0;
+    }
+}
+
+void SharedStats::publish(int index) {
+    auto &w = workers[index];
+    for (auto &item : Metrics::instance().snapshot()) {
+        // A shortened name would never match its slot again, nor be told apart from others
+        if (item.first.size() >= SHARED_STAT_NAME_LEN)
+            continue;
+        int count = w.count.load(memory_order_relaxed);
+        int i = 0;
+        while (i < count && strcmp(w.stats[i].name, item.first.c_str()) != 0) {
+            i++;
+        }
+        if (i == count) {
+            if (count == MAX_SHARED_STATS)
+                continue;
+            // Name first, then make it visible to the supervisor
+            strcpy(w.stats[i].name, item.first.c_str());
+            w.stats[i].value.store(item.second, memory_order_relaxed);
+            w.count.store(count + 1, memory_order_release);
+        } else {
+            w.stats[i].value.store(item.second, memory_order_relaxed);
+        }
+    }
+    w.heartbeatMs = chrono::duration_cast<chrono::milliseconds>(
+            chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::vector<std::pair<std::string, int64_t>> SharedStats::aggregate() {
+    map<string, int64_t> totals;
+    for (int index = 0; index < workerCount; index++) {
+        auto &w = workers[index];
+        int count = w.count.load(memory_order_acquire);
+        for (int i = 0; i < count; i++) {
+            totals[w.stats[i].name] += w.stats[i].value.load(memory_order_relaxed);
+        }
+    }
+    return vector<pair<string, int64_t>>(totals.begin(), totals.end());
+}
+
+void SharedStats::report(Poco::Logger &logger) {
+    auto now = chrono::duration_cast<chrono::milliseconds>(
+            chrono::system_clock::now().time_since_epoch()).count();
+    for (int index = 0; index < workerCount; index++) {
+        auto &w = workers[index];
+        int64_t heartbeat = w.heartbeatMs;
+        logger.information("Worker %d: pid=%d restarts=%d last_update_ms=%d", index, (int) w.pid,
+                           (int) w.restarts, heartbeat ? (int) (now - heartbeat) : -1);
+    }
+
+    ostringstream line;
+    for (auto &item : aggregate()) {
+        line << ' ' << item.first << '=' << item.second;
+    }
+    logger.information("Metrics (all workers):" + line.str());
+}
@@ -0,0 +1,81 @@
+#ifndef PREDIX_SHAREDSTATS_H
+#define PREDIX_SHAREDSTATS_H
+
+#include <Poco/Logger.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Limits of a worker's stats slot, sized for the per-zone metrics of a dozen zones. Metrics
+// past MAX_SHARED_STATS, or with a name too long for SHARED_STAT_NAME_LEN, are not published.
+#define MAX_SHARED_STATS 512
+#define SHARED_STAT_NAME_LEN 96
+
+/**
+ * Per-worker counters shared between the supervisor and its worker processes.
+ *
+ * The segment is an anonymous shared mapping created by the supervisor before forking, so
+ * every worker (including restarted ones) inherits it. Each worker periodically copies its
+ * Metrics into its own slot; the supervisor only reads. Values are lock-free atomics, which
+ * are address-free and therefore safe across processes.
+ */
+class SharedStats {
+public:
+
+    struct Stat {
+        char name[SHARED_STAT_NAME_LEN];
+        std::atomic<int64_t> value;
+    };
+
+    struct Worker {
+        std::atomic<int64_t> pid;
+        std::atomic<int64_t> restarts;
+        // Last publish, milliseconds since epoch
+        std::atomic<int64_t> heartbeatMs;
+        // Number of named entries in 'stats', published after the name is written
+        std::atomic<int> count;
+        Stat stats[MAX_SHARED_STATS];
+    };
+
+private:
+
+    Worker *workers;
+
+    int workerCount;
+
+    size_t bytes;
+
+public:
+
+    SharedStats(int workerCount);
+
+    ~SharedStats();
+
+    int size() const { return workerCount; }
+
+    Worker &worker(int index) { return workers[index]; }
+
+    /**
+     * Copies the process Metrics into the slot of worker 'index'. Called by the worker.
+     */
+    void publish(int index);
+
+    /**
+     * Clears the counters of a worker about to be (re)started.
+     */
+    void reset(int index);
+
+    /**
+     * Sum of each metric over all workers, sorted by name.
+     */
+    std::vector<std::pair<std::string, int64_t>> aggregate();
+
+    /**
+     * Logs one line per worker and the aggregated metrics.
+     */
+    void report(Poco::Logger &logger);
+};
+
+
+#endif //PREDIX_SHAREDSTATS_H
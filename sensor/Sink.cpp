@@ -0,0 +1,350 @@
+#include "Sink.h"
+#include "PredixSink.h"
+#include "errors.h"
+#include <Poco/URI.h>
+#include <Poco/Exception.h>
+#include <iostream>
+#include <cstring>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/types.h>
+#endif
+
+// Keeps datagrams under the usual path MTU
+#define MAX_DATAGRAM_BYTES 1400
+
+using namespace std;
+
+template <typename T>
+static std::unique_ptr<Sink<T>> makeGenericSink(Configuration &cfg, const std::string &service,
+                                                const std::string &kind) {
+    if (kind == "null") {
+        return unique_ptr<Sink<T>>(new NullSink<T>());
+    } else if (kind == "line") {
+        return unique_ptr<Sink<T>>(new LineSink<T>(cfg.getString(service + ".line_target", "stdout")));
+    } else if (kind == "file") {
+        return unique_ptr<Sink<T>>(new FileSink<T>(cfg.getString(service + ".file", service + ".col"),
+                                                   cfg.getInt(service + ".fsync_ms", 1000)));
+    }
+    Poco::Logger::get("Sink").error("Invalid %s.sink: %s", service, kind);
+    throw ERR_GENERIC_EXCEPTION;
+}
+
+std::unique_ptr<TimeseriesSink> makeTimeseriesSink(Configuration &cfg) {
+    auto kind = cfg.getString("timeseries.sink", "predix");
+    Poco::Logger::get("Sink").information("Timeseries sink: %s", kind);
+    if (kind == "predix")
+        return unique_ptr<TimeseriesSink>(new PredixTimeseriesSink(cfg));
+    return makeGenericSink<TimeSeriesMessage>(cfg, "timeseries", kind);
+}
+
+std::unique_ptr<AssetSink> makeAssetSink(Configuration &cfg) {
+    auto kind = cfg.getString("asset.sink", "predix");
+    Poco::Logger::get("Sink").information("Asset sink: %s", kind);
+    if (kind == "predix")
+        return unique_ptr<AssetSink>(new PredixAssetSink(cfg));
+    return makeGenericSink<AssetMessage>(cfg, "asset", kind);
+}
+
+
+// Line protocol
+
+// Escapes measurement/tag keys and values
+static void appendEscaped(string &out, const string &str, const char *special) {
+    for (char c : str) {
+        if (strchr(special, c)) out.push_back('\\');
+        out.push_back(c);
+    }
+}
+
+static void appendNumber(string &out, double value) {
+    char buf[32];
+    int n = snprintf(buf, sizeof(buf), "%.17g", value);
+    out.append(buf, (size_t) n);
+}
+
+// Line protocol timestamps are in nanoseconds
+static void appendTimestamp(string &out, int64_t timestampMs) {
+    out.push_back(' ');
+    out.append(to_string(timestampMs * 1000000));
+    out.push_back('\n');
+}
+
+LineWriter::LineWriter(const std::string &target) {
+    if (target == "stdout")
+        return;
+
+    Poco::URI uri(target);
+    if (uri.getScheme() != "udp" || uri.getHost().empty() || uri.getPort() == 0) {
+        Poco::Logger::get("LineWriter").error("Invalid line_target: %s", target);
+        throw ERR_GENERIC_EXCEPTION;
+    }
+    address = Poco::Net::SocketAddress(uri.getHost(), uri.getPort());
+    socket.reset(new Poco::Net::DatagramSocket());
+}
+
+size_t LineWriter::flushLines() {
+    size_t bytes = buffer.size();
+    if (!socket) {
+        cout.write(buffer.data(), buffer.size());
+        cout.flush();
+        buffer.clear();
+        return bytes;
+    }
+
+    try {
+        // Split in datagrams at line boundaries
+        size_t start = 0;
+        while (start < buffer.size()) {
+            size_t end = buffer.size();
+            if (end - start > MAX_DATAGRAM_BYTES) {
+                end = buffer.rfind('\n', start + MAX_DATAGRAM_BYTES - 1) + 1;
+                if (end <= start)
+                    end = buffer.find('\n', start) + 1; // oversized line, sent on its own
+            }
+            socket->sendTo(buffer.data() + start, (int) (end - start), address);
+            start = end;
+        }
+    } catch (Poco::Exception &ex) {
+        Poco::Logger::get("LineWriter").warning("Error sending datagram: %s", ex.displayText());
+        buffer.clear();
+        throw ERR_CONNECTION_ERROR;
+    }
+    buffer.clear();
+    return bytes;
+}
+
+size_t LineWriter::write(const std::vector<TimeSeriesMessage> &batch) {
+    for (auto &msg : batch) {
+        buffer.append("timeseries,tag=");
+        appendEscaped(buffer, msg.tagname, ", =");
+        buffer.append(" value=");
+        appendNumber(buffer, msg.value);
+        appendTimestamp(buffer, msg.timestamp);
+    }
+    return flushLines();
+}
+
+size_t LineWriter::write(const std::vector<AssetMessage> &batch) {
+    for (auto &msg : batch) {
+        buffer.append("asset,sensor_id=");
+        appendEscaped(buffer, msg.sensor_id, ", =");
+        buffer.append(" val=");
+        appendNumber(buffer, msg.value);
+        buffer.append(",msg=\"");
+        appendEscaped(buffer, msg.message, "\"\\");
+        buffer.append("\",count=");
+        buffer.append(to_string(msg.count));
+        buffer.append("i,min=");
+        appendNumber(buffer, msg.minValue);
+        buffer.append(",max=");
+        appendNumber(buffer, msg.maxValue);
+        buffer.append(",first=");
+        buffer.append(to_string(msg.firstTimestamp));
+        buffer.push_back('i');
+        appendTimestamp(buffer, msg.timestamp);
+    }
+    return flushLines();
+}
+
+
+// Columnar file
+
+template <typename V>
+static inline void put(string &out, V v) {
+    char raw[sizeof(v)];
+    memcpy(raw, &v, sizeof(v));
+    out.append(raw, sizeof(v));
+}
+
+template <typename V>
+static inline V get(const char *&pos) {
+    V v;
+    memcpy(&v, pos, sizeof(v));
+    pos += sizeof(v);
+    return v;
+}
+
+ColumnarFile::ColumnarFile(const std::string &path, int fsyncMs) :
+        path(path), validSize(0), fsyncMs(fsyncMs), lastSync(chrono::steady_clock::now()),
+        logger(Poco::Logger::get("ColumnarFile")) {
+    // Writes always go to the end of the file, reads are only used by 'load'
+    file = fopen(path.c_str(), "a+b");
+    if (!file) {
+        logger.error("Cannot create sink file: %s", path);
+        throw ERR_GENERIC_EXCEPTION;
+    }
+    // Unbuffered, so each block goes to the kernel in a single write
+    setvbuf(file, nullptr, _IONBF, 0);
+
+    fseek(file, 0, SEEK_END);
+    if (ftell(file) == 0) {
+        if (fwrite(COLUMNAR_MAGIC, 1, sizeof(COLUMNAR_MAGIC), file) != sizeof(COLUMNAR_MAGIC)) {
+            logger.error("Error writing to %s", path);
+            fclose(file);
+            throw ERR_GENERIC_EXCEPTION;
+        }
+        validSize = sizeof(COLUMNAR_MAGIC);
+        logger.information("Writing to %s", path);
+    } else {
+        try {
+            load();
+        } catch (int err) {
+            fclose(file);
+            throw;
+        }
+        logger.information("Appending to %s (%d keys)", path, (int) dictionary.size());
+    }
+}
+
+void ColumnarFile::load() {
+    rewind(file);
+    char magic[sizeof(COLUMNAR_MAGIC)];
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+        memcmp(magic, COLUMNAR_MAGIC, sizeof(magic)) != 0) {
+        logger.error("Not a columnar file of this version, not appending to it: %s", path);
+        throw ERR_GENERIC_EXCEPTION;
+    }
+    validSize = sizeof(COLUMNAR_MAGIC);
+
+    string payload;
+    for (;;) {
+        char header[3 * sizeof(uint32_t)];
+        if (fread(header, 1, sizeof(header), file) != sizeof(header))
+            break;
+        const char *pos = header + 2 * sizeof(uint32_t);
+        auto payloadBytes = get<uint32_t>(pos);
+        payload.resize(payloadBytes);
+        if (fread(&payload[0], 1, payloadBytes, file) != payloadBytes || payloadBytes < sizeof(uint32_t))
+            break;
+
+        // Only the dictionary entries are needed
+        pos = payload.data();
+        const char *end = pos + payload.size();
+        auto keys = get<uint32_t>(pos);
+        bool valid = true;
+        for (uint32_t i = 0; i < keys && valid; i++) {
+            valid = (size_t) (end - pos) >= sizeof(uint32_t);
+            if (!valid)
+                break;
+            auto length = get<uint32_t>(pos);
+            valid = (size_t) (end - pos) >= length;
+            if (valid) {
+                dictionary.emplace(string(pos, length), (uint32_t) dictionary.size());
+                pos += length;
+            }
+        }
+        if (!valid) {
+            logger.error("Corrupted block in %s, not appending to it", path);
+            throw ERR_GENERIC_EXCEPTION;
+        }
+        validSize += sizeof(header) + payloadBytes;
+    }
+
+    fseek(file, 0, SEEK_END);
+    if (ftell(file) > validSize) {
+        logger.warning("Cutting off the truncated last block of %s", path);
+        truncate();
+    }
+}
+
+void ColumnarFile::truncate() {
+#ifdef _WIN32
+    int err = _chsize_s(_fileno(file), validSize);
+#else
+    int err = ftruncate(fileno(file), (off_t) validSize);
+#endif
+    if (err != 0)
+        logger.warning("Error truncating %s", path);
+}
+
+ColumnarFile::~ColumnarFile() {
+    sync(true);
+    fclose(file);
+}
+
+uint32_t ColumnarFile::intern(const std::string &key) {
+    auto it = dictionary.find(key);
+    if (it != dictionary.end())
+        return it->second;
+
+    auto id = (uint32_t) dictionary.size();
+    it = dictionary.emplace(key, id).first;
+    newKeys.push_back(&it->first);
+    return id;
+}
+
+size_t ColumnarFile::appendBlock(uint32_t kind, size_t count, const std::string &columns) {
+    string out;
+    size_t dictBytes = sizeof(uint32_t);
+    for (auto key : newKeys) dictBytes += sizeof(uint32_t) + key->size();
+    out.reserve(3 * sizeof(uint32_t) + dictBytes + columns.size());
+
+    put<uint32_t>(out, kind);
+    put<uint32_t>(out, (uint32_t) count);
+    put<uint32_t>(out, (uint32_t) (dictBytes + columns.size()));
+    put<uint32_t>(out, (uint32_t) newKeys.size());
+    for (auto key : newKeys) {
+        put<uint32_t>(out, (uint32_t) key->size());
+        out.append(*key);
+    }
+    out.append(columns);
+
+    if (fwrite(out.data(), 1, out.size(), file) != out.size()) {
+        logger.error("Error writing to %s", path);
+        // The keys of this block never made it to the file: the next block declares them
+        for (auto key : newKeys) {
+            string copy = *key;
+            dictionary.erase(copy);
+        }
+        newKeys.clear();
+        truncate();
+        throw ERR_GENERIC_EXCEPTION;
+    }
+    newKeys.clear();
+    validSize += (int64_t) out.size();
+    if (fsyncMs <= 0)
+        sync(true);
+    return out.size();
+}
+
+size_t ColumnarFile::write(const std::vector<TimeSeriesMessage> &batch) {
+    block.clear();
+    for (auto &msg : batch) put<uint32_t>(block, intern(msg.tagname));
+    for (auto &msg : batch) put(block, msg.timestamp);
+    for (auto &msg : batch) put(block, msg.value);
+    return appendBlock('T', batch.size(), block);
+}
+
+size_t ColumnarFile::write(const std::vector<AssetMessage> &batch) {
+    block.clear();
+    for (auto &msg : batch) put<uint32_t>(block, intern(msg.sensor_id));
+    for (auto &msg : batch) put(block, msg.timestamp);
+    for (auto &msg : batch) put(block, msg.value);
+    for (auto &msg : batch) {
+        put<uint32_t>(block, (uint32_t) msg.message.size());
+        block.append(msg.message);
+    }
+    for (auto &msg : batch) put(block, msg.firstTimestamp);
+    for (auto &msg : batch) put(block, msg.count);
+    for (auto &msg : batch) put(block, msg.minValue);
+    for (auto &msg : batch) put(block, msg.maxValue);
+    return appendBlock('A', batch.size(), block);
+}
+
+void ColumnarFile::sync(bool force) {
+    auto now = chrono::steady_clock::now();
+    if (!force && now - lastSync < chrono::milliseconds(fsyncMs))
+        return;
+    lastSync = now;
+#ifdef _WIN32
+    int err = _commit(_fileno(file));
+#else
+    int err = fsync(fileno(file));
+#endif
+    if (err != 0)
+        logger.warning("Error syncing %s", path);
+}
@@ -0,0 +1,210 @@
+#ifndef PREDIX_SINK_H
+#define PREDIX_SINK_H
+
+#include "Application.h"
+#include "Messages.h"
+#include <Poco/Logger.h>
+#include <Poco/Net/DatagramSocket.h>
+#include <Poco/Net/SocketAddress.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+
+// First bytes of a columnar sink file
+const char COLUMNAR_MAGIC[8] = {'P', 'S', 'C', 'O', 'L', '0', '2', '\n'};
+
+/**
+ * Destination of the batches the Sender takes from one of its queues.
+ *
+ * Each service selects its sink with "<service>.sink" (service is "timeseries" or "asset"):
+ *
+ *   predix  The Predix service (default).
+ *   null    Discards everything, to measure the generator throughput alone.
+ *   line    InfluxDB line protocol, to the standard output or a UDP endpoint
+ *           ("<service>.line_target" = stdout | udp://host:port).
+ *   file    Append-only columnar binary file ("<service>.file"), fsync'ed at most every
+ *           "<service>.fsync_ms" milliseconds (default 1000, 0 syncs every batch).
+ *
+ * Sinks are used by one thread at a time: the Sender's connect thread while they are being
+ * opened, its dispatcher rounds otherwise. Errors are thrown as the codes in errors.h; a
+ * thrown batch is rolled back and retried, so send must not partially succeed silently.
+ */
+template <typename T>
+class Sink {
+public:
+
+    virtual ~Sink() {}
+
+    // Whether open() needs the Sender to fetch an access_token first
+    virtual bool needsToken() const { return false; }
+
+    // Connection setup that doesn't need the access_token (eg. the TLS handshake). Runs
+    // concurrently with the Sender login, before open().
+    virtual void prewarm() {}
+
+    // (Re)establishes the connection with the Sender's access_token (only fetched for the
+    // sinks that need it). Called at startup and after every error.
+    virtual void open(const std::string &token) {}
+
+    /**
+     * Sends a batch, blocking until it is acknowledged/written.
+     *
+     * @return the number of bytes sent, for egress accounting.
+     */
+    virtual size_t send(const std::vector<T> &batch, int64_t batchId) = 0;
+
+    // Called once per dispatch loop, after both queues were sent
+    virtual void flush() {}
+
+    // Called once per dispatch loop, including idle ones, to check the connection liveness
+    virtual void keepalive() {}
+};
+
+typedef Sink<TimeSeriesMessage> TimeseriesSink;
+typedef Sink<AssetMessage> AssetSink;
+
+/**
+ * Creates the sink configured for the service.
+ */
+std::unique_ptr<TimeseriesSink> makeTimeseriesSink(Configuration &cfg);
+
+std::unique_ptr<AssetSink> makeAssetSink(Configuration &cfg);
+
+
+template <typename T>
+class NullSink : public Sink<T> {
+public:
+    size_t send(const std::vector<T> &batch, int64_t batchId) override { return 0; }
+};
+
+
+/**
+ * Writes InfluxDB line protocol. UDP output is split in datagrams at line boundaries.
+ */
+class LineWriter {
+
+    // Empty for the standard output
+    std::unique_ptr<Poco::Net::DatagramSocket> socket;
+
+    Poco::Net::SocketAddress address;
+
+    // Lines of the batch being written
+    std::string buffer;
+
+    size_t flushLines();
+
+public:
+
+    LineWriter(const std::string &target);
+
+    size_t write(const std::vector<TimeSeriesMessage> &batch);
+
+    size_t write(const std::vector<AssetMessage> &batch);
+};
+
+template <typename T>
+class LineSink : public Sink<T> {
+
+    LineWriter writer;
+
+public:
+
+    LineSink(const std::string &target) : writer(target) {}
+
+    size_t send(const std::vector<T> &batch, int64_t batchId) override {
+        return writer.write(batch);
+    }
+};
+
+
+/**
+ * Append-only columnar file. Starts with COLUMNAR_MAGIC, followed by blocks, one per batch:
+ *
+ *   uint32 kind ('T' timeseries, 'A' asset), uint32 count, uint32 payload bytes
+ *   uint32 new keys, then each as uint32 length + bytes (dictionary of tags/sensor ids,
+ *          ids assigned in order of appearance in the file)
+ *   uint32 key ids[count]
+ *   int64  timestamps[count]
+ *   double values[count]
+ *   (asset only) uint32 length + bytes of each message
+ *   (asset only) int64 first timestamps[count], int64 sample counts[count],
+ *                double min values[count], double max values[count]
+ *
+ * Numbers are little-endian. A block is written with a single write, so a truncated last
+ * block (crash before fsync) is detectable through its payload size.
+ *
+ * An existing file is appended to: its dictionary is loaded so new blocks keep the ids, and
+ * a truncated last block is cut off first. A block that fails to be written is cut off too,
+ * and its new keys are forgotten.
+ */
+class ColumnarFile {
+
+    FILE *file;
+
+    std::string path;
+
+    // Size of the file up to the last complete block
+    int64_t validSize;
+
+    std::unordered_map<std::string, uint32_t> dictionary;
+
+    // Block being encoded, reused across batches
+    std::string block;
+
+    // Dictionary entries first seen in the current block, only kept if the block is written
+    std::vector<const std::string *> newKeys;
+
+    int fsyncMs;
+
+    std::chrono::steady_clock::time_point lastSync;
+
+    Poco::Logger &logger;
+
+    uint32_t intern(const std::string &key);
+
+    // Loads the dictionary of an existing file, cutting off a truncated last block
+    void load();
+
+    // Cuts the file at 'validSize'
+    void truncate();
+
+    // Writes the block header, dictionary entries and the encoded 'columns'
+    size_t appendBlock(uint32_t kind, size_t count, const std::string &columns);
+
+public:
+
+    ColumnarFile(const std::string &path, int fsyncMs);
+
+    ~ColumnarFile();
+
+    size_t write(const std::vector<TimeSeriesMessage> &batch);
+
+    size_t write(const std::vector<AssetMessage> &batch);
+
+    // fsyncs if the interval elapsed
+    void sync(bool force);
+};
+
+template <typename T>
+class FileSink : public Sink<T> {
+
+    ColumnarFile file;
+
+public:
+
+    FileSink(const std::string &path, int fsyncMs) : file(path, fsyncMs) {}
+
+    size_t send(const std::vector<T> &batch, int64_t batchId) override {
+        return file.write(batch);
+    }
+
+    void flush() override {
+        file.sync(false);
+    }
+};
+
+#endif //PREDIX_SINK_H
@@ -0,0 +1,43 @@
+#include "StartupTimeline.h"
+#include "Metrics.h"
+#include <sstream>
+
+using namespace std;
+
+// Taken during static initialization, the closest we get to the process start
+static const chrono::steady_clock::time_point processStart = chrono::steady_clock::now();
+
+StartupTimeline::StartupTimeline() : start(processStart) {}
+
+StartupTimeline &StartupTimeline::instance() {
+    static StartupTimeline timeline;
+    return timeline;
+}
+
+void StartupTimeline::mark(const std::string &step) {
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(
+            chrono::steady_clock::now() - start).count();
+    {
+        unique_lock<mutex> lock(timelineMutex);
+        for (auto &item : steps) {
+            if (item.first == step)
+                return;
+        }
+        steps.emplace_back(step, (int64_t) elapsed);
+    }
+    Metrics::instance().get("startup." + step + "_ms") = (int64_t) elapsed;
+}
+
+void StartupTimeline::report(Poco::Logger &logger) {
+    ostringstream line;
+    {
+        unique_lock<mutex> lock(timelineMutex);
+        if (reported)
+            return;
+        reported = true;
+        for (auto &item : steps) {
+            line << ' ' << item.first << '=' << item.second << "ms";
+        }
+    }
+    logger.information("Startup timeline:" + line.str());
+}
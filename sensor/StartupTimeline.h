@@ -0,0 +1,50 @@
+#ifndef PREDIX_STARTUPTIMELINE_H
+#define PREDIX_STARTUPTIMELINE_H
+
+#include <Poco/Logger.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/**
+ * Records when each bootstrap step first completed, relative to the process start.
+ *
+ * Steps: config, ssl, sampling, token, ws_upgrade and first_ack. The timeline is logged
+ * (and exported as "startup.<step>_ms" metrics) when the first batch is acknowledged.
+ *
+ * This class is thread-safe.
+ */
+class StartupTimeline {
+
+    std::chrono::steady_clock::time_point start;
+
+    std::mutex timelineMutex;
+
+    std::vector<std::pair<std::string, int64_t>> steps;
+
+    bool reported = false;
+
+    StartupTimeline();
+
+public:
+
+    /**
+     * The process timeline. Times are relative to the static initialization of the program.
+     */
+    static StartupTimeline &instance();
+
+    /**
+     * Records the completion of 'step'. Only the first completion is kept.
+     */
+    void mark(const std::string &step);
+
+    /**
+     * Logs the recorded steps, once.
+     */
+    void report(Poco::Logger &logger);
+};
+
+
+#endif //PREDIX_STARTUPTIMELINE_H
@@ -0,0 +1,211 @@
+#include "Supervisor.h"
+#include "errors.h"
+#include <thread>
+#include <chrono>
+#include <csignal>
+#include <algorithm>
+#include <cerrno>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+// Supervisor loop period
+#define SUPERVISOR_POLL_MS 100
+
+// Workers failing sooner than this after starting are restarted with a growing delay
+#define WORKER_MIN_UPTIME_MS 10000
+#define WORKER_MAX_RESTART_DELAY_MS 60000
+
+using namespace std;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onStopSignal(int) {
+    stopRequested = 1;
+}
+
+static int64_t steadyMs() {
+    return chrono::duration_cast<chrono::milliseconds>(
+            chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Supervisor::Supervisor(Configuration &cfg) :
+        cfg(cfg), stats(max(1, cfg.getInt("supervisor.workers", 1))),
+        workers((size_t) stats.size()),
+        logger(Poco::Logger::get("Supervisor")) {
+}
+
+bool Supervisor::spawn(int index) {
+#ifndef _WIN32
+    stats.reset(index);
+    pid_t pid = fork();
+    if (pid < 0) {
+        logger.error("Cannot fork worker %d (errno %d)", index, errno);
+        workers[index].restartAtMs = steadyMs() + workers[index].delayMs;
+        return false;
+    }
+    if (pid == 0) {
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+#ifdef __linux__
+        // Don't outlive the supervisor
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+        return true;
+    }
+
+    auto &w = workers[index];
+    w.pid = pid;
+    w.startMs = steadyMs();
+    w.restartAtMs = 0;
+    stats.worker(index).pid = pid;
+    logger.information("Started worker %d (pid %d)", index, (int) pid);
+#endif
+    return false;
+}
+
+void Supervisor::onExit(int index, int status) {
+#ifndef _WIN32
+    auto &w = workers[index];
+    w.pid = 0;
+    stats.worker(index).pid = 0;
+
+    int code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    if (WIFSIGNALED(status)) {
+        logger.error("Worker %d killed by signal %d", index, WTERMSIG(status));
+    } else {
+        logger.error("Worker %d exited with code %d", index, code);
+    }
+
+    // Restarting won't fix the configuration
+    if (code == ERR_INVALID_CREDENTIALS || code == ERR_INVALID_REQUEST ||
+        code == ERR_INVALID_CONF_DIR) {
+        logger.error("Worker %d has an unrecoverable error, not restarting it", index);
+        w.failed = true;
+        return;
+    }
+
+    int64_t baseDelay = cfg.getInt("supervisor.restart_delay_ms", 1000);
+    if (steadyMs() - w.startMs < WORKER_MIN_UPTIME_MS) {
+        w.delayMs = min((int64_t) WORKER_MAX_RESTART_DELAY_MS, max(baseDelay, w.delayMs * 2));
+    } else {
+        w.delayMs = baseDelay;
+    }
+    w.restartAtMs = steadyMs() + w.delayMs;
+    stats.worker(index).restarts++;
+    logger.information("Restarting worker %d in %d ms", index, (int) w.delayMs);
+#endif
+}
+
+void Supervisor::stopAll() {
+#ifndef _WIN32
+    logger.information("Stopping workers");
+    for (auto &w : workers) {
+        if (w.pid > 0) kill((pid_t) w.pid, SIGTERM);
+    }
+    for (auto &w : workers) {
+        if (w.pid > 0) waitpid((pid_t) w.pid, nullptr, 0);
+        w.pid = 0;
+    }
+#endif
+}
+
+int Supervisor::run() {
+#ifdef _WIN32
+    logger.error("The supervisor mode is not supported on this platform");
+    throw ERR_GENERIC_EXCEPTION;
+#else
+    signal(SIGINT, onStopSignal);
+    signal(SIGTERM, onStopSignal);
+
+    logger.information("Starting %d workers", stats.size());
+    for (int i = 0; i < stats.size(); i++) {
+        if (spawn(i)) return i;
+    }
+
+    int reportInterval = cfg.getInt("metrics.interval", 60);
+    int64_t nextReport = steadyMs() + reportInterval * 1000;
+    while (!stopRequested) {
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            for (int i = 0; i < stats.size(); i++) {
+                if (workers[i].pid == pid) onExit(i, status);
+            }
+        }
+
+        auto now = steadyMs();
+        bool alive = false;
+        for (int i = 0; i < stats.size(); i++) {
+            auto &w = workers[i];
+            if (w.pid == 0 && !w.failed && now >= w.restartAtMs) {
+                if (spawn(i)) return i;
+            }
+            alive = alive || !w.failed;
+        }
+        if (!alive) {
+            logger.error("No workers left");
+            throw ERR_GENERIC_EXCEPTION;
+        }
+
+        if (reportInterval > 0 && now >= nextReport) {
+            stats.report(logger);
+            nextReport = now + reportInterval * 1000;
+        }
+        this_thread::sleep_for(chrono::milliseconds(SUPERVISOR_POLL_MS));
+    }
+
+    stopAll();
+    stats.report(logger);
+    return -1;
+#endif
+}
+
+// Copies every setting under 'from' to the same path under 'to'
+static void copyOverrides(Configuration &cfg, const string &from, const string &to) {
+    if (cfg.hasProperty(from) && !to.empty())
+        cfg.setString(to, cfg.getString(from));
+
+    Configuration::Keys keys;
+    cfg.keys(from, keys);
+    for (auto &key : keys) {
+        copyOverrides(cfg, from + "." + key, to.empty() ? key : to + "." + key);
+    }
+}
+
+void Supervisor::configureWorker(int index) {
+    string suffix = "." + to_string(index);
+    cfg.setInt("supervisor.index", index);
+
+    // Shard of the sensor fleet. The fleet size is kept, sensors are named after it.
+    int total = cfg.getInt("sensor.count", 1);
+    int first = (int) ((int64_t) total * index / stats.size());
+    int last = (int) ((int64_t) total * (index + 1) / stats.size());
+    cfg.setInt("sensor.first", cfg.getInt("sensor.first", 0) + first);
+    cfg.setInt("sensor.count", last - first);
+    cfg.setInt("sensor.total", total);
+    if (last == first)
+        logger.warning("Worker %d has no sensors (sensor.count < supervisor.workers)", index);
+
+    // Workers can't share ports, output files or CPUs, unless given their own below
+    cfg.setInt("history.port", cfg.getInt("history.port", 8080) + index);
+    cfg.setString("timeseries.file", cfg.getString("timeseries.file", "timeseries.col") + suffix);
+    cfg.setString("asset.file", cfg.getString("asset.file", "asset.col") + suffix);
+    if (cfg.has("capture.file"))
+        cfg.setString("capture.file", cfg.getString("capture.file") + suffix);
+    cfg.setString("tracing.file", cfg.getString("tracing.file", "trace.json") + suffix);
+    for (auto key : {"affinity.sampler", "affinity.sender", "affinity.workers"}) {
+        if (cfg.has(key)) cfg.setString(key, "");
+    }
+
+    // The supervisor reports the metrics of all workers
+    cfg.setInt("metrics.interval", 0);
+
+    copyOverrides(cfg, "supervisor.worker" + to_string(index), "");
+}
@@ -0,0 +1,75 @@
+#ifndef PREDIX_SUPERVISOR_H
+#define PREDIX_SUPERVISOR_H
+
+#include "Application.h"
+#include "SharedStats.h"
+#include <Poco/Logger.h>
+#include <vector>
+#include <cstdint>
+
+/**
+ * Multi-process mode: forks "supervisor.workers" sensor processes and restarts them when
+ * they fail, so a worker's fatal error (or crash) does not take the emulator down.
+ *
+ * Each worker owns a shard of the "sensor.count" simulated sensors. Any setting can be
+ * overridden per worker under "supervisor.worker<i>" (eg. "supervisor.worker0.sensor.client_id"
+ * for per-worker credentials). Local ports and output files get the worker index appended.
+ *
+ * The supervisor logs the workers' metrics, aggregated through SharedStats, every
+ * "metrics.interval" seconds. Workers are restarted after "supervisor.restart_delay_ms",
+ * doubled (up to a minute) while they keep failing within 10 seconds; workers that exit with
+ * an unrecoverable configuration error are not restarted.
+ *
+ * POSIX only.
+ */
+class Supervisor {
+
+    Configuration &cfg;
+
+    SharedStats stats;
+
+    struct Worker {
+        int64_t pid = 0;
+        // When the worker was started or is due to be restarted, steady clock millis
+        int64_t startMs = 0;
+        int64_t restartAtMs = 0;
+        int64_t delayMs = 0;
+        bool failed = false;
+    };
+
+    std::vector<Worker> workers;
+
+    Poco::Logger &logger;
+
+    // Returns true in the child process
+    bool spawn(int index);
+
+    void onExit(int index, int status);
+
+    void stopAll();
+
+public:
+
+    Supervisor(Configuration &cfg);
+
+    /**
+     * Runs the supervisor loop until SIGINT/SIGTERM.
+     *
+     * @return -1 in the supervisor process after all workers stopped, or the worker index
+     *         in a worker process, which must then run as a regular sensor.
+     */
+    int run();
+
+    /**
+     * Applies the shard and per-worker overrides to the configuration. Called in the worker.
+     */
+    void configureWorker(int index);
+
+    /**
+     * Publishes the worker Metrics to the supervisor. Called periodically in the worker.
+     */
+    void publish(int index) { stats.publish(index); }
+};
+
+
+#endif //PREDIX_SUPERVISOR_H
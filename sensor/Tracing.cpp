@@ -0,0 +1,237 @@
+#include "Tracing.h"
+#include <Poco/Logger.h>
+#include <Poco/Process.h>
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// How often the SIGUSR1 flag is checked
+#define DUMP_POLL_MS 200
+
+using namespace std;
+
+namespace tracing {
+
+bool enabled = false;
+
+namespace {
+
+struct Event {
+    const char *name;
+    int64_t startUs;
+    int64_t endUs;
+};
+
+/**
+ * Single writer ring of spans. Each slot is tagged with the sequence number of the span it
+ * holds, and marked while being overwritten, so the reader keeps only the slots it copied
+ * whole. Slot fields are atomics (relaxed) so the concurrent copy is not a data race; no lock
+ * is needed on either side.
+ */
+class Buffer {
+
+    struct Slot {
+        // 1 + index of the span held, 0 while empty or being written
+        atomic<uint64_t> seq;
+        atomic<const char *> name;
+        atomic<int64_t> startUs;
+        atomic<int64_t> endUs;
+
+        Slot() : seq(0), name(nullptr), startUs(0), endUs(0) {}
+    };
+
+    vector<Slot> slots;
+
+    uint64_t mask;
+
+    // Spans ever pushed
+    atomic<uint64_t> count;
+
+public:
+
+    int tid;
+
+    atomic<const char *> threadName;
+
+    Buffer(size_t capacity, int tid) : slots(capacity), mask(capacity - 1), count(0), tid(tid),
+                                       threadName(nullptr) {}
+
+    void push(const Event &event) {
+        uint64_t c = count.load(memory_order_relaxed);
+        auto &slot = slots[c & mask];
+        slot.seq.store(0, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        slot.name.store(event.name, memory_order_relaxed);
+        slot.startUs.store(event.startUs, memory_order_relaxed);
+        slot.endUs.store(event.endUs, memory_order_relaxed);
+        slot.seq.store(c + 1, memory_order_release);
+        count.store(c + 1, memory_order_release);
+    }
+
+    void snapshot(vector<Event> &out) {
+        uint64_t capacity = mask + 1;
+        uint64_t end = count.load(memory_order_acquire);
+        uint64_t begin = end > capacity ? end - capacity : 0;
+        for (uint64_t i = begin; i < end; i++) {
+            auto &slot = slots[i & mask];
+            if (slot.seq.load(memory_order_acquire) != i + 1)
+                continue;
+            Event event;
+            event.name = slot.name.load(memory_order_relaxed);
+            event.startUs = slot.startUs.load(memory_order_relaxed);
+            event.endUs = slot.endUs.load(memory_order_relaxed);
+            // Overwritten while copied: the writer moved on past this span
+            atomic_thread_fence(memory_order_acquire);
+            if (slot.seq.load(memory_order_relaxed) != i + 1)
+                continue;
+            out.push_back(event);
+        }
+    }
+};
+
+// The state is never freed: a thread may exit with spans still buffered, and other threads
+// may still record spans (or dump them) while 'exit' runs the static destructors
+mutex &buffersMutex = *new mutex();
+
+vector<Buffer *> &buffers = *new vector<Buffer *>();
+
+// Buffers of exited threads, reused by the next new ones so short-lived threads (eg. the
+// prewarm of every reconnection) don't grow the memory and the trace without bounds
+vector<Buffer *> &freeBuffers = *new vector<Buffer *>();
+
+size_t bufferCapacity = 0;
+
+string &tracePath = *new string();
+
+mutex &dumpMutex = *new mutex();
+
+volatile sig_atomic_t dumpRequested = 0;
+
+// The buffer of the current thread, released when it exits
+struct LocalBuffer {
+    Buffer *buffer = nullptr;
+
+    ~LocalBuffer() {
+        if (!buffer)
+            return;
+        buffer->threadName = nullptr;
+        unique_lock<mutex> lock(buffersMutex);
+        freeBuffers.push_back(buffer);
+    }
+};
+
+thread_local LocalBuffer localBuffer;
+
+const auto epoch = chrono::steady_clock::now();
+
+Buffer &threadBuffer() {
+    if (!localBuffer.buffer) {
+        unique_lock<mutex> lock(buffersMutex);
+        if (!freeBuffers.empty()) {
+            localBuffer.buffer = freeBuffers.back();
+            freeBuffers.pop_back();
+        } else {
+            buffers.push_back(new Buffer(bufferCapacity, (int) buffers.size() + 1));
+            localBuffer.buffer = buffers.back();
+        }
+    }
+    return *localBuffer.buffer;
+}
+
+void onDumpSignal(int) {
+    dumpRequested = 1;
+}
+
+void dumpLoop() {
+    for (;;) {
+        this_thread::sleep_for(chrono::milliseconds(DUMP_POLL_MS));
+        if (dumpRequested) {
+            dumpRequested = 0;
+            dump();
+        }
+    }
+}
+
+}
+
+int64_t nowMicros() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - epoch).count();
+}
+
+void record(const char *name, int64_t startUs, int64_t endUs) {
+    threadBuffer().push({name, startUs, endUs});
+}
+
+void setThreadName(const char *name) {
+    if (enabled)
+        threadBuffer().threadName = name;
+}
+
+void start(const std::string &path, size_t bufferSpans) {
+    if (enabled)
+        return;
+
+    // round up to a power of two so the ring index is a mask
+    bufferCapacity = 1;
+    while (bufferCapacity < bufferSpans) bufferCapacity <<= 1;
+    tracePath = path;
+    enabled = true;
+
+#ifdef SIGUSR1
+    signal(SIGUSR1, onDumpSignal);
+    thread(dumpLoop).detach();
+#endif
+    atexit(dump);
+    Poco::Logger::get("Tracing").information("Tracing enabled, dumping to %s", path);
+}
+
+void dump() {
+    if (!enabled)
+        return;
+    unique_lock<mutex> dumpLock(dumpMutex);
+
+    ofstream out(tracePath, ios::out | ios::trunc);
+    if (!out) {
+        Poco::Logger::get("Tracing").error("Cannot write trace file: %s", tracePath);
+        return;
+    }
+
+    auto pid = (long) Poco::Process::id();
+    size_t spans = 0;
+    bool first = true;
+    auto separator = [&]() -> ostream & {
+        out << (first ? "\n" : ",\n");
+        first = false;
+        return out;
+    };
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    vector<Event> events;
+    unique_lock<mutex> lock(buffersMutex);
+    for (auto &buffer : buffers) {
+        const char *name = buffer->threadName;
+        if (name) {
+            separator() << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+                        << ",\"tid\":" << buffer->tid << ",\"args\":{\"name\":\"" << name << "\"}}";
+        }
+
+        events.clear();
+        buffer->snapshot(events);
+        for (auto &event : events) {
+            separator() << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":" << pid
+                        << ",\"tid\":" << buffer->tid << ",\"ts\":" << event.startUs
+                        << ",\"dur\":" << event.endUs - event.startUs << "}";
+        }
+        spans += events.size();
+    }
+    out << "\n]}\n";
+    out.close();
+
+    Poco::Logger::get("Tracing").information("Dumped %d spans to %s", (int) spans, tracePath);
+}
+
+}
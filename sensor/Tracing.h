@@ -0,0 +1,96 @@
+#ifndef PREDIX_TRACING_H
+#define PREDIX_TRACING_H
+
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * Opt-in span tracing of the sender hot path, exported as Chrome trace-event JSON (open it in
+ * chrome://tracing or https://ui.perfetto.dev).
+ *
+ * Spans are recorded into a per-thread ring buffer written only by its thread, so recording
+ * takes no lock. The buffers are dumped to "tracing.file" on SIGUSR1 and at exit; when a
+ * buffer is full the oldest spans are overwritten. The buffer of an exited thread is taken
+ * over by the next new thread, which shows up in the trace under the same id.
+ *
+ * When tracing is disabled a span costs a single branch on a flag. Names must be string
+ * literals (only the pointer is stored):
+ *
+ *   void Sender::sendAsset() {
+ *       TRACE_SPAN(span, "asset.select");
+ *       ...
+ *       span.next("asset.post");   // ends "asset.select", starts "asset.post"
+ *       ...
+ *   }                              // ends "asset.post"
+ */
+namespace tracing {
+
+// Set by 'start' before any traced thread runs
+extern bool enabled;
+
+int64_t nowMicros();
+
+/**
+ * Records a completed span in the calling thread buffer. Use Span instead.
+ */
+void record(const char *name, int64_t startUs, int64_t endUs);
+
+class Span {
+
+    const char *name;
+
+    int64_t startUs;
+
+public:
+
+    explicit Span(const char *name) : name(name), startUs(enabled ? nowMicros() : -1) {}
+
+    ~Span() {
+        end();
+    }
+
+    // Ends this span and starts 'next' in its place
+    void next(const char *next) {
+        if (startUs < 0)
+            return;
+        int64_t now = nowMicros();
+        record(name, startUs, now);
+        name = next;
+        startUs = now;
+    }
+
+    // Drops this span, e.g. when there was nothing to do
+    void discard() {
+        startUs = -1;
+    }
+
+    void end() {
+        if (startUs < 0)
+            return;
+        record(name, startUs, nowMicros());
+        startUs = -1;
+    }
+};
+
+/**
+ * Enables tracing. 'bufferSpans' is the capacity of each thread buffer. Installs the SIGUSR1
+ * handler and registers 'dump' with 'atexit'.
+ */
+void start(const std::string &path, size_t bufferSpans);
+
+/**
+ * Names the calling thread in the trace.
+ */
+void setThreadName(const char *name);
+
+/**
+ * Writes every buffered span to the trace file.
+ */
+void dump();
+
+}
+
+#define TRACE_SPAN(var, name) tracing::Span var(name)
+
+#endif //PREDIX_TRACING_H
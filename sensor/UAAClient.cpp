@@ -0,0 +1,36 @@
+#include "UAAClient.h"
+#include "HTTPClient.h"
+#include <nlohmann/json.hpp>
+
+using namespace std;
+using namespace nlohmann;
+
+UAAClient::UAAClient(const std::string &uri, const std::string &clientId,
+                     const std::string &clientSecret, uint64_t timeout) :
+        uri(uri + "/oauth/token"), clientId(clientId), clientSecret(clientSecret),
+        timeout(timeout), logger(Poco::Logger::get("UAAClient")) {
+}
+
+UAAClient::Token UAAClient::fetchToken() {
+    logger.information("Fetching OAuth access token.");
+
+    auto client = HTTPClient(uri);
+    client.setBasicAuth(clientId, clientSecret);
+    client.setTimeout(timeout);
+    client.setSessionPool(pool);
+    auto form = FormBody();
+    form.set("response_type", "token");
+    form.set("grant_type", "client_credentials");
+    client.setBody(form.toString());
+    client.setContentType(HTTPClient::CT_FORM);
+    auto r = client.post();
+
+    HTTPClient::validateResponse(r);
+
+    auto data = json::parse(r.text);
+    Token token;
+    token.accessToken = data["access_token"];
+    token.expiresIn = data.count("expires_in") ? (int64_t) data["expires_in"] : 0;
+    logger.information("Got OAuth access token.");
+    return token;
+}
@@ -0,0 +1,47 @@
+#ifndef PREDIX_UAACLIENT_H
+#define PREDIX_UAACLIENT_H
+
+#include <string>
+#include <cstdint>
+#include <Poco/Logger.h>
+#include "HTTPSessionPool.h"
+
+/**
+ * Fetches OAuth2 access tokens from the UAA service using the client credentials grant.
+ */
+class UAAClient {
+
+    std::string uri;
+    std::string clientId;
+    std::string clientSecret;
+    uint64_t timeout;
+
+    HTTPSessionPool *pool = nullptr;
+
+    Poco::Logger &logger;
+
+public:
+
+    struct Token {
+        std::string accessToken;
+        // Seconds the token is valid for, as reported by UAA (0 if unknown)
+        int64_t expiresIn;
+    };
+
+    /**
+     * @param uri UAA base URI (ie. "uaa.uri")
+     * @param timeout request timeout in millis
+     */
+    UAAClient(const std::string &uri, const std::string &clientId,
+              const std::string &clientSecret, uint64_t timeout);
+
+    void setSessionPool(HTTPSessionPool *pool) { this->pool = pool; }
+
+    /**
+     * Requests a new token. Throws the error codes in errors.h on failure.
+     */
+    Token fetchToken();
+};
+
+
+#endif //PREDIX_UAACLIENT_H
@@ -8,11 +8,17 @@
 #include <Poco/Net/HTTPStreamFactory.h>
 #include <Poco/Net/HTTPSStreamFactory.h>
 #include <Poco/Net/HTTPSClientSession.h>
+#include <Poco/Net/SecureStreamSocket.h>
+#include <Poco/Net/SSLManager.h>
+#include <Poco/Net/SSLException.h>
+#include <Poco/Net/NetException.h>
 #include <Poco/Net/HTTPRequest.h>
 #include <Poco/Net/HTTPResponse.h>
 #include <Poco/URI.h>
 #include <Poco/Logger.h>
 #include "errors.h"
+#include "Metrics.h"
+#include <algorithm>
 using namespace Poco::Net;
 using namespace std;
 
@@ -24,7 +30,7 @@ void WSClient::connect() {
     uint16_t port = uri.getPort();
     string path = uri.getPath();
 
-    HTTPSClientSession cs(host, port);
+    HTTPSClientSession cs(host, port, SSLManager::instance().defaultClientContext(), sslSession);
     HTTPRequest request(HTTPRequest::HTTP_GET, path, HTTPMessage::HTTP_1_1);
     for (auto& item : headersMap) {
         request.set(item.first, item.second);
@@ -34,14 +40,49 @@ void WSClient::connect() {
         ws = make_shared<WebSocket>(cs, request, response);
         ws->setKeepAlive(true);
         ws->setBlocking(true);
-    } catch (Poco::Exception ex) {
+        sslSession = cs.sslSession();
+        lastReceived = chrono::steady_clock::now();
+        pingPending = false;
+    } catch (WebSocketException &ex) {
         if (ex.code() == WebSocket::WS_ERR_UNAUTHORIZED) {
             throw ERR_INVALID_TOKEN;
+        } else if (response.getStatus() >= 500 && response.getStatus() <= 599) {
+            logger.warning("Server error connecting to websocket client. Status: %d", (int) response.getStatus());
+            throw ERR_SERVER_ERROR;
         } else {
             logger.error("Unexpected error connecting to websocket client. Cause: %s", ex.message());
             // An error here is unexpected.
             throw ERR_GENERIC_EXCEPTION;
         }
+    } catch (SSLException &ex) {
+        // Eg. an untrusted certificate, retrying won't help
+        logger.error("TLS error connecting to websocket client. Cause: %s", ex.message());
+        throw ERR_GENERIC_EXCEPTION;
+    } catch (NetException &ex) {
+        // Refused, reset, unreachable... the server may be restarting
+        logger.warning("Cannot connect to websocket client. Cause: %s", ex.message());
+        throw ERR_CONNECTION_ERROR;
+    } catch (Poco::TimeoutException &ex) {
+        logger.warning("Timed-out connecting to websocket client");
+        throw ERR_CONNECTION_ERROR;
+    } catch (Poco::Exception &ex) {
+        logger.error("Unexpected error connecting to websocket client. Cause: %s", ex.message());
+        // An error here is unexpected.
+        throw ERR_GENERIC_EXCEPTION;
+    }
+}
+
+void WSClient::prewarm() {
+    Poco::URI uri(this->uri);
+    try {
+        SecureStreamSocket socket(SocketAddress(uri.getHost(), uri.getPort()), uri.getHost(),
+                                  SSLManager::instance().defaultClientContext());
+        socket.completeHandshake();
+        sslSession = socket.currentSession();
+        socket.close();
+    } catch (Poco::Exception ex) {
+        // Not fatal, connect() will do a full handshake
+        logger.warning("Cannot pre-warm the TLS session. Cause: %s", ex.displayText());
     }
 }
 
@@ -49,7 +90,12 @@ void WSClient::setHeader(std::string key, std::string value) {
     headersMap[key] = value;
 }
 
-WSClient::WSClient(std::string uri): uri(uri), logger(Poco::Logger::get("WSClient")) {
+WSClient::WSClient(std::string uri, const std::string &metricPrefix):
+                                     uri(uri), pingInterval(0), pongTimeout(0), pingPending(false),
+                                     pingsMetric(Metrics::instance().get(metricPrefix + ".pings")),
+                                     pongRttMetric(Metrics::instance().get(metricPrefix + ".pong_rtt_ms")),
+                                     lostMetric(Metrics::instance().get(metricPrefix + ".lost")),
+                                     logger(Poco::Logger::get("WSClient")) {
 
 }
 
@@ -66,23 +112,108 @@ void WSClient::sendText(std::string text) {
 		}
 }
 
-std::string WSClient::receiveText() {
+int WSClient::receiveFrame(std::string &payload) {
     char buf[4096];
     int flags;
+    int n = ws->receiveFrame(buf, sizeof(buf), flags);
+    int op = flags & WebSocket::FRAME_OP_BITMASK;
+    if ((n == 0 && flags == 0) || op == WebSocket::FRAME_OP_CLOSE) {
+        lostMetric++;
+        logger.warning("Connection closed by the server");
+        throw ERR_CONNECTION_LOST;
+    }
+
+    // Any frame proves the connection alive
+    auto now = chrono::steady_clock::now();
+    if (pingPending && op == WebSocket::FRAME_OP_PONG) {
+        pongRttMetric = chrono::duration_cast<chrono::milliseconds>(now - pingSent).count();
+    }
+    lastReceived = now;
+    pingPending = false;
+
+    if (op == WebSocket::FRAME_OP_PING) {
+        ws->sendFrame(buf, n, WebSocket::FRAME_FLAG_FIN | WebSocket::FRAME_OP_PONG);
+    }
+    payload.assign(buf, (unsigned long) n);
+    return op;
+}
+
+long WSClient::nextLivenessMs() {
+    auto due = pingPending ? pingSent + chrono::milliseconds(pongTimeout)
+                           : lastReceived + chrono::milliseconds(pingInterval);
+    auto ms = chrono::duration_cast<chrono::milliseconds>(due - chrono::steady_clock::now());
+    return max(1L, (long) ms.count());
+}
+
+void WSClient::checkLiveness() {
+    auto now = chrono::steady_clock::now();
+    if (pingPending) {
+        if (now - pingSent >= chrono::milliseconds(pongTimeout)) {
+            lostMetric++;
+            logger.warning("No frame received %ld ms after a PING, the connection is dead",
+                           (long) chrono::duration_cast<chrono::milliseconds>(now - pingSent).count());
+            throw ERR_CONNECTION_LOST;
+        }
+    } else if (now - lastReceived >= chrono::milliseconds(pingInterval)) {
+        ws->setSendTimeout(Poco::Timespan(0, sendTimeout * 1000));
+        ws->sendFrame("", 0, WebSocket::FRAME_FLAG_FIN | WebSocket::FRAME_OP_PING);
+        pingSent = now;
+        pingPending = true;
+        pingsMetric++;
+    }
+}
+
+std::string WSClient::receiveText() {
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(recvTimeout);
+    string payload;
     try {
         ws->setReceiveTimeout(Poco::Timespan(0, recvTimeout * 1000));
-        int n = ws->receiveFrame(buf, sizeof(buf), flags);
-        if (flags & WebSocket::FRAME_OP_TEXT) {
-            string recv(buf, (unsigned long) n);
-            return recv;
-        } else {
-            logger.error("Invalid frame type. Flags: %d", flags);
-            // Anything but a text frame here is undefined behavior.
-            throw ERR_INVALID_REQUEST;
+        for (;;) {
+            if (pingInterval > 0) {
+                // Wake up to ping while waiting, so a dead link is noticed before the timeout
+                auto remaining = chrono::duration_cast<chrono::milliseconds>(
+                        deadline - chrono::steady_clock::now()).count();
+                if (remaining <= 0)
+                    throw Poco::TimeoutException();
+                long wait = min((long) remaining, nextLivenessMs());
+                if (!ws->poll(Poco::Timespan(0, wait * 1000), Socket::SELECT_READ)) {
+                    checkLiveness();
+                    continue;
+                }
+            }
+
+            int op = receiveFrame(payload);
+            if (op == WebSocket::FRAME_OP_TEXT) {
+                return payload;
+            } else if (op != WebSocket::FRAME_OP_PING && op != WebSocket::FRAME_OP_PONG) {
+                logger.error("Invalid frame type. Opcode: %d", op);
+                // Anything but a text frame here is undefined behavior.
+                throw ERR_INVALID_REQUEST;
+            }
         }
     } catch (Poco::TimeoutException ex) {
         logger.warning("Timed-out when waiting TEXT frame");
         throw ERR_REQUEST_TIMEOUT;
+    } catch (Poco::Exception ex) {
+        logger.warning("Error receiving TEXT frame. Reason: " + ex.message());
+        throw ERR_CONNECTION_ERROR;
+    }
+}
+
+void WSClient::keepalive() {
+    if (!ws || pingInterval <= 0)
+        return;
+    string payload;
+    try {
+        while (ws->poll(Poco::Timespan(0), Socket::SELECT_READ)) {
+            if (receiveFrame(payload) == WebSocket::FRAME_OP_TEXT) {
+                logger.warning("Ignoring a TEXT frame received while idle");
+            }
+        }
+        checkLiveness();
+    } catch (Poco::Exception ex) {
+        logger.warning("Error checking the connection. Reason: " + ex.message());
+        throw ERR_CONNECTION_ERROR;
     }
 }
 
@@ -94,6 +225,14 @@ void WSClient::setRecvTimeout(long ms) {
     this->recvTimeout = ms;
 }
 
+void WSClient::setPingInterval(long ms) {
+    this->pingInterval = ms;
+}
+
+void WSClient::setPongTimeout(long ms) {
+    this->pongTimeout = ms;
+}
+
 void WSClient::checkConnected() {
     if (!ws) {
         throw std::runtime_error("Please call 'connect()' first.");
@@ -8,11 +8,19 @@
 #include <string>
 #include <unordered_map>
 #include <memory>
+#include <chrono>
+#include <atomic>
 #include <Poco/Net/WebSocket.h>
+#include <Poco/Net/Session.h>
 #include <Poco/Logger.h>
 
 /**
  * Facade wrapping the POCO websocket library for simplicity.
+ *
+ * Liveness: after "ping interval" ms without receiving any frame a PING is sent, and the
+ * connection is declared dead (ERR_CONNECTION_LOST) when nothing arrives within "pong
+ * timeout" ms of it. This runs while waiting for a TEXT frame and on 'keepalive', so a
+ * half-open connection is noticed in about interval + timeout instead of the recv timeout.
  */
 class WSClient {
 
@@ -25,36 +33,85 @@ class WSClient {
     // Pointer to the underlying websocket connection
     std::shared_ptr<Poco::Net::WebSocket> ws;
 
+    // TLS session of the last handshake, resumed by the next connection
+    Poco::Net::Session::Ptr sslSession;
+
     // Send timeout in millis
     long sendTimeout;
 
     // Recv timeout in millis
     long recvTimeout;
 
+    // Silence before a PING is sent, in millis. 0 disables the pings.
+    long pingInterval;
+
+    // Time a PING has to be answered (by any frame), in millis
+    long pongTimeout;
+
+    // When the last frame was received
+    std::chrono::steady_clock::time_point lastReceived;
+
+    // When the unanswered PING was sent
+    std::chrono::steady_clock::time_point pingSent;
+
+    bool pingPending;
+
+    // PING frames sent
+    std::atomic<int64_t> &pingsMetric;
+
+    // Round-trip of the last PONG
+    std::atomic<int64_t> &pongRttMetric;
+
+    // Connections declared dead or closed by the server
+    std::atomic<int64_t> &lostMetric;
+
     Poco::Logger& logger;
 
+    // Receives a frame, answering PINGs. Returns the opcode.
+    int receiveFrame(std::string &payload);
+
+    // Milliseconds until 'checkLiveness' has something to do
+    long nextLivenessMs();
+
+    // Sends a PING when due, throws ERR_CONNECTION_LOST when the last one is overdue
+    void checkLiveness();
+
 public:
-    // Initialize the ws client
-    WSClient(std::string uri);
+    // Initialize the ws client. Metrics are named '<metricPrefix>.pings' etc.
+    WSClient(std::string uri, const std::string &metricPrefix = "ws");
 
     // Connect to the remote service
     void connect();
 
+    // Performs a TLS handshake with the server ahead of 'connect', which then resumes the
+    // session instead of negotiating a new one. Does not need the headers.
+    void prewarm();
+
     // Sets an additional header value
     void setHeader(std::string key, std::string value);
 
     // Sends a TEXT frame (blocking)
     void sendText(std::string text);
 
-    // Receives a TEXT frame (blocking)
+    // Receives a TEXT frame (blocking). Control frames are handled in the meantime.
     std::string receiveText();
 
+    // Handles the control frames received while idle and checks the connection liveness.
+    // Call it regularly (more often than the ping interval) between requests.
+    void keepalive();
+
     // Timeout when sending
     void setSendTimeout(long ms);
 
     // Timeout when receiving
     void setRecvTimeout(long ms);
 
+    // Silence before a PING is sent, 0 disables them
+    void setPingInterval(long ms);
+
+    // Deadline for any frame after a PING
+    void setPongTimeout(long ms);
+
     void checkConnected();
 
 
@@ -0,0 +1,85 @@
+#include "Zone.h"
+#include "errors.h"
+#include <Poco/Util/MapConfiguration.h>
+#include <set>
+#include <sstream>
+
+using namespace std;
+
+// Copies every setting under 'from' to the same path under 'to'
+static void copyTree(Configuration &cfg, const string &from, Poco::Util::AbstractConfiguration &dest,
+                     const string &to) {
+    if (cfg.hasProperty(from) && !to.empty())
+        dest.setString(to, cfg.getString(from));
+
+    Configuration::Keys keys;
+    cfg.keys(from, keys);
+    for (auto &key : keys) {
+        copyTree(cfg, from + "." + key, dest, to.empty() ? key : to + "." + key);
+    }
+}
+
+std::vector<std::string> Zone::names(Configuration &base) {
+    vector<string> names;
+    set<string> seen;
+    istringstream in(base.getString("zones.names", ""));
+    string name;
+    while (getline(in, name, ',')) {
+        auto first = name.find_first_not_of(" \t\r\n");
+        if (first == string::npos)
+            continue;
+        name = name.substr(first, name.find_last_not_of(" \t\r\n") - first + 1);
+        if (!seen.insert(name).second) {
+            Poco::Logger::get("Zone").error("Duplicated zone: %s", name);
+            throw ERR_GENERIC_EXCEPTION;
+        }
+        names.push_back(name);
+    }
+    if (names.empty())
+        names.push_back("");
+    return names;
+}
+
+Poco::AutoPtr<Configuration> Zone::makeConfig(Configuration &base, const std::string &name) {
+    if (name.empty())
+        return Poco::AutoPtr<Configuration>(&base, true);
+
+    Poco::AutoPtr<Poco::Util::MapConfiguration> overrides(new Poco::Util::MapConfiguration());
+    copyTree(base, "zone." + name, *overrides, "");
+
+    // Zones can't share output files, unless given their own
+    string suffix = "." + name;
+    if (!overrides->has("timeseries.file"))
+        overrides->setString("timeseries.file", base.getString("timeseries.file", "timeseries.col") + suffix);
+    if (!overrides->has("asset.file"))
+        overrides->setString("asset.file", base.getString("asset.file", "asset.col") + suffix);
+    if (!overrides->has("capture.file") && base.has("capture.file"))
+        overrides->setString("capture.file", base.getString("capture.file") + suffix);
+    overrides->setString("sender.zone", name);
+
+    // The global memory budget is shared by the zones without their own
+    if (!overrides->has("memory.budget_mb") && base.has("memory.budget_mb")) {
+        int sharing = 0;
+        for (auto &zone : names(base)) {
+            if (!base.has("zone." + zone + ".memory.budget_mb"))
+                sharing++;
+        }
+        overrides->setDouble("memory.budget_mb", base.getDouble("memory.budget_mb") / sharing);
+    }
+
+    // Zone settings first, then the global ones
+    Poco::AutoPtr<Configuration> cfg(new Configuration());
+    cfg->addWriteable(overrides.get(), -1);
+    cfg->add(&base, 0);
+    return cfg;
+}
+
+Zone::Zone(Configuration &base, const std::string &name, HistoryStore &history) :
+        name(name), cfg(makeConfig(base, name)), sender(*cfg, history), sampler(*cfg, sender),
+        replayer(*cfg, sender) {
+    if (!name.empty()) {
+        Poco::Logger::get("Zone").information("Zone %s: timeseries zone %s, client %s", name,
+                                              cfg->getString("timeseries.zone_id", ""),
+                                              cfg->getString("sensor.client_id", ""));
+    }
+}
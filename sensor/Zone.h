@@ -0,0 +1,61 @@
+#ifndef PREDIX_ZONE_H
+#define PREDIX_ZONE_H
+
+#include "Application.h"
+#include "Sender.h"
+#include "Sampler.h"
+#include "Replayer.h"
+#include "HistoryStore.h"
+#include <Poco/AutoPtr.h>
+#include <string>
+#include <vector>
+
+/**
+ * A tenant the emulator ingests into: its own configuration, Sender (credentials, token,
+ * connections and queues) and Sampler/Replayer.
+ *
+ * Zones are listed in "zones.names" (comma separated). The configuration of zone <name> is
+ * every "zone.<name>.*" setting layered over the global ones, eg.:
+ *
+ *   [zones]
+ *   names = plant-a, plant-b
+ *
+ *   [zone.plant-a]
+ *   sensor.client_id = ...
+ *   sensor.client_secret = ...
+ *   timeseries.zone_id = ...
+ *   asset.zone_id = ...
+ *
+ * Unless given their own, zones write their output files ("timeseries.file", "asset.file",
+ * "capture.file") with a ".<name>" suffix. The global "memory.budget_mb" is split evenly
+ * between the zones that don't set their own, so together they stay within it. Without
+ * "zones.names" there is a single unnamed zone using the global configuration as is.
+ */
+class Zone {
+
+    std::string name;
+
+    Poco::AutoPtr<Configuration> cfg;
+
+    static Poco::AutoPtr<Configuration> makeConfig(Configuration &base, const std::string &name);
+
+public:
+
+    Sender sender;
+
+    Sampler sampler;
+
+    Replayer replayer;
+
+    // The configured zone names, a single empty name when there are none
+    static std::vector<std::string> names(Configuration &base);
+
+    Zone(Configuration &base, const std::string &name, HistoryStore &history);
+
+    const std::string &getName() const { return name; }
+
+    Configuration &config() { return *cfg; }
+};
+
+
+#endif //PREDIX_ZONE_H
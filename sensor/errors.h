@@ -29,6 +29,10 @@ const int ERR_INVALID_TOKEN = 6;
 // Thrown when we get a recoverable connection error.
 const int ERR_CONNECTION_ERROR = 7;
 
+// Thrown when an established connection is found dead or closed by the server. Recoverable
+// by reconnecting right away.
+const int ERR_CONNECTION_LOST = 8;
+
 // When an error/exception was detected. Unrecoverable. The throwing function should
 // log the error cause.
 const int ERR_GENERIC_EXCEPTION = 99;
@@ -0,0 +1,127 @@
+// AlertCoalescer state machine: a burst that clears, a long burst re-alerted every
+// realert_ms, a burst too close to the previous record merged into the next one, flushing
+// pending alerts, and coalescing turned off.
+
+#include "AlertCoalescer.h"
+#include "Check.h"
+#include <Poco/Util/LayeredConfiguration.h>
+#include <Poco/Util/MapConfiguration.h>
+#include <Poco/AutoPtr.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Sample timestamps are milliseconds since epoch
+#define T0 1500000000000LL
+
+static Poco::AutoPtr<Configuration> makeConfig(bool coalesce) {
+    Poco::AutoPtr<Configuration> cfg(new Configuration());
+    cfg->add(new Poco::Util::MapConfiguration());
+    cfg->setBool("alert.coalesce", coalesce);
+    cfg->setInt("alert.clear_samples", 3);
+    cfg->setInt("alert.realert_ms", 1000);
+    return cfg;
+}
+
+int main() {
+    auto cfg = makeConfig(true);
+    vector<string> ids = {"s0", "s1"};
+    vector<AssetMessage> out;
+
+    // A burst that clears after 3 quiet samples
+    {
+        AlertCoalescer alerts(*cfg, ids.size(), "overload");
+        alerts.sample(0, ids[0], T0, 5, true, out);
+        alerts.sample(0, ids[0], T0 + 10, 7, true, out);
+        alerts.sample(0, ids[0], T0 + 20, 6, true, out);
+        alerts.sample(0, ids[0], T0 + 30, 0.5, false, out);
+        alerts.sample(0, ids[0], T0 + 40, 0.5, false, out);
+        CHECK(out.empty());
+        alerts.sample(0, ids[0], T0 + 50, 0.5, false, out);
+        CHECK(out.size() == 1);
+        if (out.size() == 1) {
+            CHECK(out[0].sensor_id == "s0" && out[0].message == "overload");
+            CHECK(out[0].count == 3);
+            CHECK(out[0].firstTimestamp == T0 && out[0].timestamp == T0 + 20);
+            CHECK(out[0].value == 6 && out[0].minValue == 5 && out[0].maxValue == 7);
+        }
+        // Quiet sensors stay quiet, and the other sensor is independent
+        alerts.sample(0, ids[0], T0 + 60, 0.5, false, out);
+        alerts.sample(1, ids[1], T0 + 60, 0.5, false, out);
+        CHECK(out.size() == 1);
+        out.clear();
+    }
+
+    // A long burst is reported every realert_ms while it lasts
+    {
+        AlertCoalescer alerts(*cfg, ids.size(), "overload");
+        for (int64_t t = 0; t <= 2500; t += 100) alerts.sample(1, ids[1], T0 + t, 9, true, out);
+        CHECK(out.size() == 2);
+        if (out.size() == 2) {
+            CHECK(out[0].firstTimestamp == T0 && out[0].timestamp == T0 + 1000);
+            CHECK(out[0].count == 11);
+            CHECK(out[1].firstTimestamp == T0 + 1100 && out[1].timestamp == T0 + 2100);
+            CHECK(out[1].count == 11);
+        }
+
+        // Flushing reports the rest of the burst right away, once
+        out.clear();
+        alerts.flush(ids, out);
+        CHECK(out.size() == 1);
+        if (out.size() == 1) {
+            CHECK(out[0].sensor_id == "s1");
+            CHECK(out[0].firstTimestamp == T0 + 2200 && out[0].timestamp == T0 + 2500);
+            CHECK(out[0].count == 4);
+        }
+        out.clear();
+        alerts.flush(ids, out);
+        CHECK(out.empty());
+    }
+
+    // A burst cleared within realert_ms of the previous record is merged into the next one
+    {
+        AlertCoalescer alerts(*cfg, ids.size(), "overload");
+        alerts.sample(0, ids[0], T0, 5, true, out);
+        for (int64_t t = 10; t <= 30; t += 10) alerts.sample(0, ids[0], T0 + t, 0.5, false, out);
+        CHECK(out.size() == 1);
+        out.clear();
+
+        alerts.sample(0, ids[0], T0 + 100, 6, true, out);
+        for (int64_t t = 110; t <= 400; t += 10) alerts.sample(0, ids[0], T0 + t, 0.5, false, out);
+        alerts.sample(0, ids[0], T0 + 500, 8, true, out);
+        for (int64_t t = 600; t < 1000; t += 100) alerts.sample(0, ids[0], T0 + t, 0.5, false, out);
+        CHECK(out.empty());
+
+        // Re-alerted once realert_ms passed since the previous record
+        alerts.sample(0, ids[0], T0 + 1000, 0.5, false, out);
+        CHECK(out.size() == 1);
+        if (out.size() == 1) {
+            CHECK(out[0].count == 2);
+            CHECK(out[0].firstTimestamp == T0 + 100 && out[0].timestamp == T0 + 500);
+            CHECK(out[0].minValue == 6 && out[0].maxValue == 8);
+        }
+        out.clear();
+    }
+
+    // Without coalescing every alarm sample is a record
+    {
+        auto plain = makeConfig(false);
+        AlertCoalescer alerts(*plain, ids.size(), "overload");
+        alerts.sample(0, ids[0], T0, 5, true, out);
+        alerts.sample(0, ids[0], T0 + 10, 6, true, out);
+        alerts.sample(0, ids[0], T0 + 20, 0.5, false, out);
+        alerts.sample(0, ids[0], T0 + 30, 7, true, out);
+        CHECK(out.size() == 3);
+        for (auto &msg : out) {
+            CHECK(msg.count == 1);
+            CHECK(msg.firstTimestamp == msg.timestamp);
+            CHECK(msg.minValue == msg.value && msg.maxValue == msg.value);
+        }
+        out.clear();
+        alerts.flush(ids, out);
+        CHECK(out.empty());
+    }
+
+    return CHECK_RESULT();
+}
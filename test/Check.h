@@ -0,0 +1,22 @@
+#ifndef PREDIX_CHECK_H
+#define PREDIX_CHECK_H
+
+#include <cstdio>
+
+/**
+ * Minimal assertions for the unit tests. A failed CHECK is reported and the test goes on;
+ * the test program returns CHECK_RESULT() from main so ctest sees the failure.
+ */
+static int checkFailures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            checkFailures++; \
+        } \
+    } while (0)
+
+#define CHECK_RESULT() (checkFailures == 0 ? 0 : 1)
+
+#endif //PREDIX_CHECK_H
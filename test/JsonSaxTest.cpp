@@ -0,0 +1,92 @@
+// JsonSaxParser: the same events whatever the chunking (tokens split across chunks),
+// string escapes, \u escapes including surrogate pairs, and syntax errors.
+
+#include "JsonSax.h"
+#include "errors.h"
+#include "Check.h"
+#include <algorithm>
+#include <string>
+
+using namespace std;
+
+// Records the events as a compact string
+class Recorder : public JsonSaxHandler {
+public:
+    string events;
+
+    void startObject() override { events += "{"; }
+
+    void endObject() override { events += "}"; }
+
+    void startArray() override { events += "["; }
+
+    void endArray() override { events += "]"; }
+
+    void key(const std::string &name) override { events += "k:" + name + ";"; }
+
+    void stringValue(const std::string &value) override { events += "s:" + value + ";"; }
+
+    void numberValue(double, const std::string &raw) override { events += "n:" + raw + ";"; }
+
+    void boolValue(bool value) override { events += value ? "true;" : "false;"; }
+
+    void nullValue() override { events += "null;"; }
+};
+
+// Parses 'doc' fed in chunks of 'chunk' bytes
+static string parse(const string &doc, size_t chunk) {
+    Recorder recorder;
+    JsonSaxParser parser(recorder);
+    for (size_t pos = 0; pos < doc.size(); pos += chunk) {
+        parser.feed(doc.data() + pos, min(chunk, doc.size() - pos));
+    }
+    parser.finish();
+    return recorder.events;
+}
+
+static bool fails(const string &doc) {
+    try {
+        parse(doc, doc.size());
+    } catch (int err) {
+        return err == ERR_GENERIC_EXCEPTION;
+    }
+    return false;
+}
+
+int main() {
+    // Tokens split at every possible position
+    string doc = R"({"tags": [{"name": "t-1", "values": [[1500000000000, -12.5e-1, 3], [2, null, true]]}],)"
+                 R"( "ok": false})";
+    string expected = "{k:tags;[{k:name;s:t-1;k:values;[[n:1500000000000;n:-12.5e-1;n:3;][n:2;null;true;]]}]"
+                      "k:ok;false;}";
+    for (size_t chunk = 1; chunk <= doc.size(); chunk++) {
+        CHECK(parse(doc, chunk) == expected);
+    }
+
+    // A top-level number only ends with the document
+    CHECK(parse("42", 1) == "n:42;");
+
+    // Escapes, split too
+    string escapes = R"(["a\"b\\c\/d\n\t\r\b\f", "\u0041\u00e9\u20ac"])";
+    for (size_t chunk = 1; chunk <= escapes.size(); chunk++) {
+        CHECK(parse(escapes, chunk) == "[s:a\"b\\c/d\n\t\r\b\f;s:A\xc3\xa9\xe2\x82\xac;]");
+    }
+
+    // A surrogate pair is a single 4 byte UTF-8 character, unpaired halves are replaced
+    string pair = R"(["\uD83D\uDE00", "\ud83d\ude00x"])";
+    for (size_t chunk = 1; chunk <= pair.size(); chunk++) {
+        CHECK(parse(pair, chunk) == "[s:\xf0\x9f\x98\x80;s:\xf0\x9f\x98\x80x;]");
+    }
+    CHECK(parse(R"(["\uD83Dx", "\uDE00", "\uD83D\n", "\uD83D"])", 3) ==
+          "[s:\xef\xbf\xbdx;s:\xef\xbf\xbd;s:\xef\xbf\xbd\n;s:\xef\xbf\xbd;]");
+
+    // Syntax errors
+    CHECK(fails("[1, 2"));
+    CHECK(fails("[1, 2}"));
+    CHECK(fails("[tru]"));
+    CHECK(fails("[1.2.3]"));
+    CHECK(fails(R"(["\u12G4"])"));
+    CHECK(fails(R"(["open)"));
+
+    return CHECK_RESULT();
+}
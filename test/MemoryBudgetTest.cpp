@@ -0,0 +1,41 @@
+// MemoryBudget accounting, and shutdown waking up a producer blocked on a full budget.
+
+#include "MemoryBudget.h"
+#include "Check.h"
+#include <Poco/Util/LayeredConfiguration.h>
+#include <Poco/Util/MapConfiguration.h>
+#include <Poco/AutoPtr.h>
+#include <atomic>
+#include <thread>
+
+using namespace std;
+
+#define MB (1024 * 1024)
+
+int main() {
+    Poco::AutoPtr<Configuration> cfg(new Configuration());
+    cfg->add(new Poco::Util::MapConfiguration());
+    cfg->setInt("memory.budget_mb", 1);
+    MemoryBudget budget(*cfg);
+
+    // Accounting, and a message larger than the whole budget
+    CHECK(budget.reserve(MB / 2, true));
+    CHECK(!budget.reserve(MB, false));
+    CHECK(!budget.reserve(2 * MB, true));
+    budget.release(MB / 2);
+    CHECK(budget.reserve(MB, false));
+
+    // A producer waiting for room returns false on shutdown
+    atomic<int> result(-1);
+    thread producer([&]() { result = budget.reserve(1, true) ? 1 : 0; });
+    budget.shutdown();
+    producer.join();
+    CHECK(result == 0);
+
+    // and doesn't wait anymore, though what fits is still accepted
+    CHECK(!budget.reserve(1, true));
+    budget.release(MB);
+    CHECK(budget.reserve(1, true));
+
+    return CHECK_RESULT();
+}
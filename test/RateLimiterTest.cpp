@@ -0,0 +1,69 @@
+// TokenBucket refill, debt and capacity, and the EgressLimiter allowance for rates under one
+// point per second.
+
+#include "RateLimiter.h"
+#include "Check.h"
+#include <Poco/Util/LayeredConfiguration.h>
+#include <Poco/Util/MapConfiguration.h>
+#include <Poco/AutoPtr.h>
+#include <chrono>
+
+using namespace std;
+
+// The buckets are driven with explicit times, so the test doesn't depend on the scheduler
+static const TokenBucket::TimePoint T0;
+
+static TokenBucket::TimePoint at(int ms) {
+    return T0 + chrono::milliseconds(ms);
+}
+
+int main() {
+    // Unlimited
+    TokenBucket unlimited;
+    CHECK(unlimited.unlimited());
+    unlimited.consume(1e9);
+    CHECK(unlimited.available() > 1e9);
+
+    // Starts full, refills at the rate and never over capacity
+    TokenBucket bucket(100, 1, at(0));
+    CHECK(bucket.available(at(0)) == 100);
+    bucket.consume(100, at(0));
+    CHECK(bucket.available(at(0)) == 0);
+    CHECK(bucket.available(at(100)) == 10);
+    CHECK(bucket.available(at(250)) == 25);
+    CHECK(bucket.available(at(5000)) == 100);
+
+    // Consuming more than available leaves the bucket in debt, paid at the rate
+    bucket.consume(150, at(5000));
+    CHECK(bucket.available(at(5000)) == -50);
+    CHECK(bucket.available(at(5400)) == -10);
+
+    // Rates under one token per burst still hold a whole token
+    TokenBucket slow(0.5, 1, at(0));
+    CHECK(slow.available(at(0)) == 1);
+    slow.consume(1, at(0));
+    CHECK(slow.available(at(1000)) == 0.5);
+    CHECK(slow.available(at(3000)) == 1);
+
+    TokenBucket shortBurst(5, 0.1, at(0));
+    CHECK(shortBurst.available(at(0)) == 1);
+    shortBurst.consume(1, at(0));
+    CHECK(shortBurst.available(at(300)) == 1);
+
+    // A newly limited bucket starts full, at least one token
+    TokenBucket limited(0, 1, at(0));
+    limited.setRate(0.2, 1, at(0));
+    CHECK(!limited.unlimited());
+    CHECK(limited.available(at(0)) == 1);
+
+    // The egress allowance lets one point through at sub-1 rates
+    Poco::AutoPtr<Configuration> cfg(new Configuration());
+    cfg->add(new Poco::Util::MapConfiguration());
+    cfg->setString("egress.timeseries.points_per_sec", "0.5");
+    EgressLimiter egress(*cfg, "timeseries");
+    CHECK(egress.allowance(10) == 1);
+    egress.onSent(1, 0, 100);
+    CHECK(egress.allowance(10) == 0);
+
+    return CHECK_RESULT();
+}
@@ -0,0 +1,93 @@
+// RetryPolicy delays: immediate first retry, jittered exponential backoff within its bounds,
+// and the circuit breaker opening, staying open on a failed trial and closing on success.
+
+#include "RetryPolicy.h"
+#include "errors.h"
+#include "Check.h"
+#include <Poco/Util/LayeredConfiguration.h>
+#include <Poco/Util/MapConfiguration.h>
+#include <Poco/AutoPtr.h>
+#include <set>
+
+using namespace std;
+
+static Poco::AutoPtr<Configuration> makeConfig(int breakerFailures) {
+    Poco::AutoPtr<Configuration> cfg(new Configuration());
+    cfg->add(new Poco::Util::MapConfiguration());
+    cfg->setInt("retry.base_ms", 100);
+    cfg->setInt("retry.max_ms", 1000);
+    cfg->setInt("retry.breaker_failures", breakerFailures);
+    cfg->setInt("retry.breaker_open_ms", 2000);
+    return cfg;
+}
+
+int main() {
+    auto cfg = makeConfig(3);
+
+    // A first transient failure is retried right away, further ones back off with jitter
+    // within [0, base * 2^(failures - 1)], capped at max_ms
+    set<int64_t> seen;
+    for (int round = 0; round < 50; round++) {
+        RetryPolicy policy(*cfg, "test");
+        CHECK(policy.onError(ERR_CONNECTION_LOST) == 0);
+        for (int failure = 2; failure <= 12; failure++) {
+            int64_t delay = policy.onError(failure % 2 ? ERR_REQUEST_TIMEOUT : ERR_CONNECTION_ERROR);
+            int64_t bound = min((int64_t) 1000, (int64_t) 100 << (failure - 1));
+            CHECK(delay >= 0 && delay <= bound);
+            if (failure == 2) seen.insert(delay);
+        }
+        CHECK(policy.failureCount() == 12);
+        CHECK(!policy.breakerOpen());
+    }
+    // Jittered, not a fixed delay
+    CHECK(seen.size() > 10);
+
+    // An acknowledged batch ends the outage: the next failure is retried right away again
+    RetryPolicy policy(*cfg, "test");
+    policy.onError(ERR_CONNECTION_LOST);
+    policy.onError(ERR_CONNECTION_LOST);
+    policy.onSuccess();
+    CHECK(policy.failureCount() == 0);
+    CHECK(policy.onError(ERR_CONNECTION_LOST) == 0);
+    policy.onSuccess();
+
+    // Server errors are never retried right away, and open the breaker after 3 in a row
+    for (int i = 1; i <= 2; i++) {
+        int64_t delay = policy.onError(ERR_SERVER_ERROR);
+        CHECK(delay >= 0 && delay <= (100 << (i - 1)));
+        CHECK(!policy.breakerOpen());
+    }
+    int64_t delay = policy.onError(ERR_SERVER_ERROR);
+    CHECK(policy.breakerOpen());
+    CHECK(delay >= 1000 && delay <= 2000);
+
+    // Half open: a failed trial keeps it open for another period
+    delay = policy.onError(ERR_SERVER_ERROR);
+    CHECK(policy.breakerOpen());
+    CHECK(delay >= 1000 && delay <= 2000);
+
+    // A trial failing otherwise closes it, back to the exponential backoff
+    delay = policy.onError(ERR_CONNECTION_ERROR);
+    CHECK(!policy.breakerOpen());
+    CHECK(delay >= 0 && delay <= 1000);
+
+    // A successful trial closes it for good
+    for (int i = 0; i < 3; i++) policy.onError(ERR_SERVER_ERROR);
+    CHECK(policy.breakerOpen());
+    policy.onSuccess();
+    CHECK(!policy.breakerOpen());
+    delay = policy.onError(ERR_SERVER_ERROR);
+    CHECK(!policy.breakerOpen());
+    CHECK(delay >= 0 && delay <= 100);
+
+    // breaker_failures = 0 disables the breaker
+    auto noBreaker = makeConfig(0);
+    RetryPolicy unbroken(*noBreaker, "test");
+    for (int i = 0; i < 10; i++) {
+        delay = unbroken.onError(ERR_SERVER_ERROR);
+        CHECK(!unbroken.breakerOpen());
+        CHECK(delay >= 0 && delay <= 1000);
+    }
+
+    return CHECK_RESULT();
+}
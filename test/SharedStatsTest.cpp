@@ -0,0 +1,51 @@
+// SharedStats publishing: repeated publishes update the slot of each metric in place, names
+// as long as the zone-prefixed ones included, and names too long for a slot are skipped.
+
+#include "SharedStats.h"
+#include "Metrics.h"
+#include "Check.h"
+#include <string>
+
+using namespace std;
+
+static int64_t aggregated(SharedStats &stats, const string &name, int &found) {
+    int64_t value = 0;
+    found = 0;
+    for (auto &item : stats.aggregate()) {
+        if (item.first == name) {
+            value = item.second;
+            found++;
+        }
+    }
+    return value;
+}
+
+int main() {
+    SharedStats stats(2);
+    string longName = "zone.plant-a-north-building.retry.timeseries.total_recovery_ms";
+    string tooLong = "zone." + string(SHARED_STAT_NAME_LEN, 'x') + ".batch.size";
+    CHECK(longName.size() > 48 && longName.size() < SHARED_STAT_NAME_LEN);
+
+    Metrics::instance().get(longName) = 5;
+    Metrics::instance().get(tooLong) = 1;
+    stats.publish(0);
+    int count = stats.worker(0).count;
+
+    // The second publish finds the slot of every metric
+    Metrics::instance().get(longName) = 7;
+    stats.publish(0);
+    CHECK(stats.worker(0).count == count);
+
+    int found;
+    CHECK(aggregated(stats, longName, found) == 7);
+    CHECK(found == 1);
+    aggregated(stats, tooLong, found);
+    CHECK(found == 0);
+
+    // Workers add up
+    stats.publish(1);
+    CHECK(aggregated(stats, longName, found) == 14);
+    CHECK(found == 1);
+
+    return CHECK_RESULT();
+}